@@ -3,7 +3,35 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/iosched.h"
+#include "devices/timer.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Most sectors that the dispatcher merges into one driver call. */
+#define BLOCK_MERGE_MAX 64
+
+/* Priority of the dispatcher threads.  Above the default, so that
+   when a transfer completes, the dispatcher preempts threads doing
+   bulk computation to complete it and start the next one. */
+#define BLOCK_DISPATCHER_PRI (PRI_DEFAULT + 1)
+
+/* A request queue in front of a block device's driver.  Threads
+   that do I/O add requests to the queue, and then sleep or go on
+   with other work.  A dispatcher thread per device removes them
+   in the order chosen by the I/O scheduler, merges requests for
+   adjacent sectors, calls the driver, and completes them. */
+struct block_queue
+  {
+    struct lock lock;                   /* Protects all members. */
+    struct condition nonempty;          /* Signaled when a request
+                                           arrives. */
+    struct request_queue requests;      /* Queued requests. */
+    const struct iosched *sched;        /* Scheduler. */
+    size_t depth;                       /* Number of queued requests. */
+    struct block_queue_stats stats;     /* Statistics. */
+  };
 
 /* A block device. */
 struct block
@@ -19,6 +47,9 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+
+    struct block_queue *queue;          /* Request queue, or null to call
+                                           the driver directly. */
   };
 
 /* List of all block devices. */
@@ -27,7 +58,12 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 /* The block block assigned to each Pintos role. */
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
+/* Scheduler for request queues started later. */
+static const struct iosched *default_sched = &iosched_clook;
+
 static struct block *list_elem_to_block (struct list_elem *);
+static void block_io (struct block *, bool write, block_sector_t, size_t cnt,
+                      uint8_t *buffer, void *buffers[]);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -121,7 +157,7 @@ void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
   check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
+  block_io (block, false, sector, 1, buffer, NULL);
   block->read_cnt++;
 }
 
@@ -135,10 +171,83 @@ block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
   check_sector (block, sector);
   ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
+  block_io (block, true, sector, 1, (uint8_t *) buffer, NULL);
   block->write_cnt++;
 }
 
+/* Verifies that the CNT sectors starting at SECTOR are all within
+   BLOCK.  Panics if not. */
+static void
+check_sectors (struct block *block, block_sector_t sector, size_t cnt)
+{
+  ASSERT (cnt > 0);
+  check_sector (block, sector);
+  if (cnt > block->size - sector)
+    check_sector (block, sector + (block_sector_t) (cnt - 1));
+}
+
+/* Reads the CNT sectors starting at SECTOR from BLOCK into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes.  Uses a
+   single request if the driver supports it.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                     void *buffer)
+{
+  check_sectors (block, sector, cnt);
+  block_io (block, false, sector, cnt, buffer, NULL);
+  block->read_cnt += cnt;
+}
+
+/* Writes the CNT sectors starting at SECTOR to BLOCK from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Uses a single
+   request if the driver supports it.  Returns after the block
+   device has acknowledged receiving the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                      const void *buffer)
+{
+  check_sectors (block, sector, cnt);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  block_io (block, true, sector, cnt, (uint8_t *) buffer, NULL);
+  block->write_cnt += cnt;
+}
+
+/* Reads the CNT sectors starting at SECTOR from BLOCK, sector
+   SECTOR + I into BUFFERS[I], each of which must have room for
+   BLOCK_SECTOR_SIZE bytes.  Uses a single request if the driver
+   supports it.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_scatter (struct block *block, block_sector_t sector, size_t cnt,
+                    void *buffers[])
+{
+  check_sectors (block, sector, cnt);
+  block_io (block, false, sector, cnt, NULL, buffers);
+  block->read_cnt += cnt;
+}
+
+/* Writes the CNT sectors starting at SECTOR to BLOCK, sector
+   SECTOR + I from BUFFERS[I], each of which must contain
+   BLOCK_SECTOR_SIZE bytes.  Uses a single request if the driver
+   supports it.  Returns after the block device has acknowledged
+   receiving the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_gather (struct block *block, block_sector_t sector, size_t cnt,
+                    const void *buffers[])
+{
+  check_sectors (block, sector, cnt);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  block_io (block, true, sector, cnt, NULL, (void **) buffers);
+  block->write_cnt += cnt;
+}
+
 /* Returns the number of sectors in BLOCK. */
 block_sector_t
 block_size (struct block *block)
@@ -160,10 +269,12 @@ block_type (struct block *block)
   return block->type;
 }
 
-/* Prints statistics for each block device used for a Pintos role. */
+/* Prints statistics for each block device used for a Pintos role
+   and for each request queue. */
 void
 block_print_stats (void)
 {
+  struct list_elem *e;
   int i;
 
   for (i = 0; i < BLOCK_ROLE_CNT; i++)
@@ -176,6 +287,22 @@ block_print_stats (void)
                   block->read_cnt, block->write_cnt);
         }
     }
+
+  for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
+       e = list_next (e))
+    {
+      struct block *block = list_entry (e, struct block, list_elem);
+      struct block_queue_stats s;
+
+      if (block_get_queue_stats (block, &s) == 0 && s.requests > 0)
+        printf ("%s (%s queue): %llu requests in %llu dispatches, "
+                "avg depth %llu, max depth %zu, "
+                "avg latency %lld ticks, max latency %lld ticks\n",
+                block->name, block->queue->sched->name,
+                s.requests, s.dispatches, s.depth_sum / s.requests,
+                s.max_depth, s.latency_sum / (int64_t) s.requests,
+                s.max_latency);
+    }
 }
 
 /* Stores the cache statistics in the corresponding argument references. */
@@ -191,6 +318,20 @@ block_get_stats (struct block *block, long long *read_count,
   return 0;
 }
 
+/* Stores BLOCK's request queue statistics in *STATS.  Returns 0
+   if successful, -1 if BLOCK has no request queue. */
+int
+block_get_queue_stats (struct block *block, struct block_queue_stats *stats)
+{
+  if (block == NULL || block->queue == NULL || stats == NULL)
+    return -1;
+
+  lock_acquire (&block->queue->lock);
+  *stats = block->queue->stats;
+  lock_release (&block->queue->lock);
+  return 0;
+}
+
 /* Registers a new block device with the given NAME.  If
    EXTRA_INFO is non-null, it is printed as part of a user
    message.  The block device's SIZE in sectors and its TYPE must
@@ -213,6 +354,7 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->queue = NULL;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -224,6 +366,391 @@ block_register (const char *name, enum block_type type,
   return block;
 }
 
+/* Request queues. */
+
+/* Selects the I/O scheduler named NAME for request queues started
+   afterward.  Returns true if successful, false if there is no
+   such scheduler. */
+bool
+block_configure_scheduler (const char *name)
+{
+  const struct iosched *sched = iosched_find (name);
+  if (sched == NULL)
+    return false;
+  default_sched = sched;
+  return true;
+}
+
+static thread_func block_dispatcher NO_RETURN;
+
+/* Puts a request queue, with its own dispatcher thread, in front
+   of BLOCK's driver.  Drivers for physical devices call this
+   right after block_register(), so that the device's requests
+   are scheduled and merged.  Devices layered on another device,
+   such as partitions, should not, because their requests end up
+   in the underlying device's queue anyway.  If memory is short,
+   BLOCK keeps calling its driver directly. */
+void
+block_start_queue (struct block *block)
+{
+  struct block_queue *q;
+  char name[sizeof block->name + 3];
+
+  ASSERT (block->queue == NULL);
+
+  q = calloc (1, sizeof *q);
+  if (q == NULL)
+    return;
+  lock_init (&q->lock);
+  cond_init (&q->nonempty);
+  list_init (&q->requests.by_sector);
+  list_init (&q->requests.by_deadline);
+  q->requests.head = 0;
+  q->sched = default_sched;
+
+  block->queue = q;
+  snprintf (name, sizeof name, "%s-io", block->name);
+  if (thread_create (name, BLOCK_DISPATCHER_PRI, block_dispatcher,
+                     block) == TID_ERROR)
+    {
+      block->queue = NULL;
+      free (q);
+    }
+}
+
+/* Calls BLOCK's driver to transfer the CNT sectors starting at
+   SECTOR, from or to the contiguous BUFFER or the per-sector
+   BUFFERS, whichever is non-null.  Writes if WRITE is true,
+   otherwise reads.  Falls back to single-sector operations that
+   the driver does not provide. */
+static void
+block_transfer (struct block *block, bool write, block_sector_t sector,
+                size_t cnt, uint8_t *buffer, void *buffers[])
+{
+  const struct block_operations *ops = block->ops;
+  size_t i;
+
+  if (write)
+    {
+      if (buffers != NULL && ops->write_gather != NULL)
+        ops->write_gather (block->aux, sector, cnt, (const void **) buffers);
+      else if (buffers == NULL && cnt > 1 && ops->write_multiple != NULL)
+        ops->write_multiple (block->aux, sector, cnt, buffer);
+      else
+        for (i = 0; i < cnt; i++)
+          ops->write (block->aux, sector + i,
+                      (buffers != NULL ? buffers[i]
+                       : buffer + i * BLOCK_SECTOR_SIZE));
+    }
+  else
+    {
+      if (buffers != NULL && ops->read_scatter != NULL)
+        ops->read_scatter (block->aux, sector, cnt, buffers);
+      else if (buffers == NULL && cnt > 1 && ops->read_multiple != NULL)
+        ops->read_multiple (block->aux, sector, cnt, buffer);
+      else
+        for (i = 0; i < cnt; i++)
+          ops->read (block->aux, sector + i,
+                     (buffers != NULL ? buffers[i]
+                      : buffer + i * BLOCK_SECTOR_SIZE));
+    }
+}
+
+/* Returns true if deadline_elem A precedes B. */
+static bool
+deadline_less (const struct list_elem *a_, const struct list_elem *b_,
+               void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request,
+                                              deadline_elem);
+  const struct block_request *b = list_entry (b_, struct block_request,
+                                              deadline_elem);
+  return a->deadline < b->deadline;
+}
+
+/* Returns true if sector_elem A precedes B. */
+static bool
+sector_less (const struct list_elem *a_, const struct list_elem *b_,
+             void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request,
+                                              sector_elem);
+  const struct block_request *b = list_entry (b_, struct block_request,
+                                              sector_elem);
+  return a->dev_sector < b->dev_sector;
+}
+
+/* Marks R complete, by calling its completion function or by
+   waking up its waiter.  R must not be touched afterward. */
+static void
+complete_request (struct block_request *r)
+{
+  if (r->complete != NULL)
+    r->complete (r, r->aux);
+  else
+    sema_up (&r->done);
+}
+
+/* Passes R, already checked against BLOCK, down through any
+   devices that BLOCK is mapped onto, and then adds it to the
+   request queue of the device at the bottom.  If that device has
+   no queue, does the transfer and completes R right away. */
+static void
+queue_request (struct block *block, struct block_request *r)
+{
+  struct block_queue *q;
+
+  r->dev_sector = r->sector;
+  while (block->ops->map != NULL)
+    {
+      block = block->ops->map (block->aux, &r->dev_sector);
+      check_sectors (block, r->dev_sector, r->cnt);
+      if (r->write)
+        block->write_cnt += r->cnt;
+      else
+        block->read_cnt += r->cnt;
+    }
+
+  q = block->queue;
+  if (q == NULL)
+    {
+      block_transfer (block, r->write, r->dev_sector, r->cnt,
+                      r->buffer, r->buffers);
+      complete_request (r);
+      return;
+    }
+
+  r->submitted = timer_ticks ();
+  r->deadline = r->submitted + (r->write ? IOSCHED_WRITE_EXPIRE
+                                : IOSCHED_READ_EXPIRE);
+
+  lock_acquire (&q->lock);
+  list_insert_ordered (&q->requests.by_sector, &r->sector_elem,
+                       sector_less, NULL);
+  list_insert_ordered (&q->requests.by_deadline, &r->deadline_elem,
+                       deadline_less, NULL);
+  q->depth++;
+  q->stats.depth_sum += q->depth;
+  if (q->depth > q->stats.max_depth)
+    q->stats.max_depth = q->depth;
+  cond_signal (&q->nonempty, &q->lock);
+  lock_release (&q->lock);
+}
+
+/* Initializes R to transfer the CNT sectors starting at SECTOR,
+   from or to the contiguous BUFFER or the per-sector BUFFERS,
+   exactly one of which must be non-null.  Writes if WRITE is
+   true, otherwise reads.  If COMPLETE is non-null, it is called
+   with R and AUX when the transfer is done; otherwise, wait for
+   R with block_wait(). */
+void
+block_request_init (struct block_request *r, bool write,
+                    block_sector_t sector, size_t cnt,
+                    void *buffer, void *buffers[],
+                    block_complete_func *complete, void *aux)
+{
+  ASSERT (r != NULL);
+  ASSERT ((buffer == NULL) != (buffers == NULL));
+
+  r->write = write;
+  r->sector = sector;
+  r->cnt = cnt;
+  r->buffer = buffer;
+  r->buffers = buffers;
+  r->complete = complete;
+  r->aux = aux;
+  sema_init (&r->done, 0);
+}
+
+/* Starts request R on BLOCK and returns, usually before the
+   transfer is done.  The buffers must not be touched until R
+   completes.
+
+   A completion function runs in the dispatcher thread of the
+   device at the bottom of BLOCK, or in the caller if that device
+   has no request queue.  It must not sleep for long and must not
+   wait for other I/O on the same device. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  check_sectors (block, r->sector, r->cnt);
+  if (r->write)
+    {
+      ASSERT (block->type != BLOCK_FOREIGN);
+      block->write_cnt += r->cnt;
+    }
+  else
+    block->read_cnt += r->cnt;
+  queue_request (block, r);
+}
+
+/* Waits for request R, which must have no completion function,
+   to complete. */
+void
+block_wait (struct block_request *r)
+{
+  ASSERT (r->complete == NULL);
+  sema_down (&r->done);
+}
+
+/* Returns true if request R, which must have no completion
+   function, has completed, false if it is still in progress.  Once
+   this returns true, R must not be waited for again. */
+bool
+block_try_wait (struct block_request *r)
+{
+  ASSERT (r->complete == NULL);
+  return sema_try_down (&r->done);
+}
+
+/* Transfers the CNT sectors starting at SECTOR between BLOCK and
+   BUFFER or BUFFERS, as described for block_request_init(),
+   through BLOCK's request queue if it has one.  Returns when the
+   transfer is complete.  The caller must already have checked
+   and counted the sectors. */
+static void
+block_io (struct block *block, bool write, block_sector_t sector, size_t cnt,
+          uint8_t *buffer, void *buffers[])
+{
+  struct block_request r;
+
+  block_request_init (&r, write, sector, cnt, buffer, buffers, NULL, NULL);
+  queue_request (block, &r);
+  block_wait (&r);
+}
+
+/* Returns the request before or after R in sector order, if it
+   can be merged into a dispatch that already covers the CNT
+   sectors from START, or a null pointer otherwise. */
+static struct block_request *
+mergeable (struct request_queue *rq, struct block_request *r, bool before,
+           block_sector_t start, size_t cnt)
+{
+  struct list_elem *e;
+  struct block_request *m;
+
+  if (before)
+    {
+      if (&r->sector_elem == list_begin (&rq->by_sector))
+        return NULL;
+      e = list_prev (&r->sector_elem);
+    }
+  else
+    {
+      e = list_next (&r->sector_elem);
+      if (e == list_end (&rq->by_sector))
+        return NULL;
+    }
+  m = list_entry (e, struct block_request, sector_elem);
+
+  if (m->write != r->write || cnt + m->cnt > BLOCK_MERGE_MAX)
+    return NULL;
+  if (before
+      ? m->dev_sector + m->cnt != start
+      : m->dev_sector != start + cnt)
+    return NULL;
+  return m;
+}
+
+/* Dispatcher thread for the request queue of BLOCK_. */
+static void
+block_dispatcher (void *block_)
+{
+  struct block *block = block_;
+  struct block_queue *q = block->queue;
+  void *buffers[BLOCK_MERGE_MAX];
+
+  for (;;)
+    {
+      struct block_request *first, *last, *r, *m;
+      struct list batch;
+      struct list_elem *e;
+      block_sector_t start;
+      size_t cnt;
+      int64_t now;
+
+      /* Choose a request and extend it with adjacent requests in
+         the same direction. */
+      lock_acquire (&q->lock);
+      while (list_empty (&q->requests.by_sector))
+        cond_wait (&q->nonempty, &q->lock);
+      first = last = r = q->sched->select (&q->requests);
+      start = r->dev_sector;
+      cnt = r->cnt;
+      while ((m = mergeable (&q->requests, first, true, start, cnt)) != NULL)
+        {
+          first = m;
+          start = m->dev_sector;
+          cnt += m->cnt;
+        }
+      while ((m = mergeable (&q->requests, last, false, start, cnt)) != NULL)
+        {
+          last = m;
+          cnt += m->cnt;
+        }
+
+      /* Take the requests out of the queue. */
+      list_init (&batch);
+      for (r = first; ; r = m)
+        {
+          bool done = r == last;
+          m = list_entry (list_next (&r->sector_elem), struct block_request,
+                          sector_elem);
+          list_remove (&r->sector_elem);
+          list_remove (&r->deadline_elem);
+          list_push_back (&batch, &r->sector_elem);
+          q->depth--;
+          if (done)
+            break;
+        }
+      q->requests.head = start + cnt;
+      lock_release (&q->lock);
+
+      /* Do the I/O. */
+      if (first == last)
+        block_transfer (block, first->write, first->dev_sector, first->cnt,
+                        first->buffer, first->buffers);
+      else
+        {
+          size_t i = 0;
+
+          for (e = list_begin (&batch); e != list_end (&batch);
+               e = list_next (e))
+            {
+              size_t j;
+
+              r = list_entry (e, struct block_request, sector_elem);
+              for (j = 0; j < r->cnt; j++)
+                buffers[i++] = (r->buffers != NULL ? r->buffers[j]
+                                : r->buffer + j * BLOCK_SECTOR_SIZE);
+            }
+          block_transfer (block, first->write, start, cnt, NULL, buffers);
+        }
+
+      /* Account for the requests, then complete them outside the
+         lock, because completion functions may take other locks.
+         A request may be freed as soon as it completes. */
+      now = timer_ticks ();
+      lock_acquire (&q->lock);
+      q->stats.dispatches++;
+      for (e = list_begin (&batch); e != list_end (&batch); e = list_next (e))
+        {
+          int64_t latency;
+
+          r = list_entry (e, struct block_request, sector_elem);
+          latency = now - r->submitted;
+          q->stats.requests++;
+          q->stats.latency_sum += latency;
+          if (latency > q->stats.max_latency)
+            q->stats.max_latency = latency;
+        }
+      lock_release (&q->lock);
+      while (!list_empty (&batch))
+        complete_request (list_entry (list_pop_front (&batch),
+                                      struct block_request, sector_elem));
+    }
+}
+
 /* Returns the block device corresponding to LIST_ELEM, or a null
    pointer if LIST_ELEM is the list end of all_blocks. */
 static struct block *
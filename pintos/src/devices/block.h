@@ -1,8 +1,11 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <list.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,24 +56,108 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, size_t cnt, void *);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *);
+void block_read_scatter (struct block *, block_sector_t, size_t cnt,
+                         void *buffers[]);
+void block_write_gather (struct block *, block_sector_t, size_t cnt,
+                         const void *buffers[]);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Asynchronous I/O. */
+
+struct block_request;
+
+/* Called when request R completes. */
+typedef void block_complete_func (struct block_request *r, void *aux);
+
+/* An asynchronous block I/O request.  Initialize with
+   block_request_init(), start with block_submit(), and then
+   either wait for it with block_wait() or let its completion
+   function run.  The request must stay allocated until then. */
+struct block_request
+  {
+    /* Set by block_request_init(). */
+    bool write;                 /* Write to device or read from it? */
+    block_sector_t sector;      /* First sector. */
+    size_t cnt;                 /* Number of sectors. */
+    uint8_t *buffer;            /* Contiguous buffer, or null. */
+    void **buffers;             /* One buffer per sector, or null. */
+    block_complete_func *complete;      /* Completion function, or null. */
+    void *aux;                  /* Passed to COMPLETE. */
+
+    /* Owned by the block layer. */
+    block_sector_t dev_sector;  /* First sector on the queued device. */
+    struct list_elem sector_elem;       /* Element in by_sector list. */
+    struct list_elem deadline_elem;     /* Element in by_deadline list. */
+    int64_t submitted;          /* Timer tick when queued. */
+    int64_t deadline;           /* Timer tick by which to dispatch. */
+    struct semaphore done;      /* Up'd on completion if no COMPLETE. */
+  };
+
+void block_request_init (struct block_request *, bool write,
+                         block_sector_t, size_t cnt,
+                         void *buffer, void *buffers[],
+                         block_complete_func *, void *aux);
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+bool block_try_wait (struct block_request *);
+
 /* Statistics. */
 void block_print_stats (void);
 int block_get_stats (struct block *block, long long *read_count, 
                                           long long *write_count);
 
+/* Request queue statistics. */
+struct block_queue_stats
+  {
+    unsigned long long requests;        /* Requests completed. */
+    unsigned long long dispatches;      /* Driver calls, after merging. */
+    unsigned long long depth_sum;       /* Sum of queue depths seen by
+                                           arriving requests. */
+    size_t max_depth;                   /* Greatest queue depth. */
+    int64_t latency_sum;                /* Sum of ticks from submission
+                                           to completion. */
+    int64_t max_latency;                /* Greatest latency in ticks. */
+  };
+
+int block_get_queue_stats (struct block *, struct block_queue_stats *);
+
 /* Lower-level interface to block device drivers. */
 
+/* READ and WRITE transfer a single sector and are required.  The
+   rest transfer CNT consecutive sectors, from or to one contiguous
+   BUFFER or from or to one sector-sized buffer per sector in
+   BUFFERS.  They are optional: if a driver leaves them null, the
+   block layer falls back to calling READ or WRITE once per sector.
+
+   MAP is for devices that are a range of sectors of another
+   device, such as partitions.  If it is non-null, the block layer
+   passes requests to the device that it returns, after it adds
+   the range's offset to *SECTOR, so that they are queued there. */
 struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+    void (*read_multiple) (void *aux, block_sector_t, size_t cnt,
+                           void *buffer);
+    void (*write_multiple) (void *aux, block_sector_t, size_t cnt,
+                            const void *buffer);
+    void (*read_scatter) (void *aux, block_sector_t, size_t cnt,
+                          void *buffers[]);
+    void (*write_gather) (void *aux, block_sector_t, size_t cnt,
+                          const void *buffers[]);
+    struct block *(*map) (void *aux, block_sector_t *sector);
   };
 
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
 
+/* Request queues. */
+bool block_configure_scheduler (const char *name);
+void block_start_queue (struct block *);
+
 #endif /* devices/block.h */
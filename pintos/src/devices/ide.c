@@ -3,12 +3,15 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/block.h"
 #include "devices/partition.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -34,6 +37,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +53,49 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+
+#define CMD_READ_DMA 0xc8              /* READ DMA. */
+#define CMD_WRITE_DMA 0xca             /* WRITE DMA. */
+
+/* Most sectors a single READ or WRITE command can transfer.  The
+   sector count register holds 0 for this value. */
+#define MAX_SECTORS_PER_COMMAND 256
+
+/* PCI bus-master IDE (BMIDE) port addresses, relative to the
+   base address in BAR4 of the IDE controller, which has 8 ports
+   for each channel. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0)  /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)   /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)     /* PRD table. */
+
+/* Bus-master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus-master Status Register bits. */
+#define BM_STA_ACTIVE 0x01      /* Transfer in progress. */
+#define BM_STA_ERR 0x02         /* Error (write 1 to clear). */
+#define BM_STA_INTR 0x04        /* Interrupt (write 1 to clear). */
+
+/* A Physical Region Descriptor, one entry in the table that
+   tells the bus master where to transfer data.  A region must be
+   2-byte aligned and may not cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Size in bytes; 0 means 64 kB. */
+    uint16_t flags;             /* PRD_EOT or 0. */
+  };
+
+#define PRD_EOT 0x8000          /* Last entry in table. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))
+
+/* Sectors that a DMA transfer may copy through a channel's bounce
+   page, for buffers that the bus master cannot reach directly. */
+#define BOUNCE_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +104,9 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple;               /* Sectors per interrupt with READ/WRITE
+                                   MULTIPLE, or 0 if not in use. */
+    bool dma;                   /* Transfer data by bus-master DMA? */
   };
 
 /* An ATA channel (aka controller).
@@ -72,6 +122,11 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    /* Bus-master DMA, if bm_base is nonzero. */
+    uint16_t bm_base;           /* Base bus-master I/O port. */
+    struct prd *prdt;           /* Physical Region Descriptor table. */
+    uint8_t *bounce;            /* Bounce page, BOUNCE_SECTORS sectors. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -85,7 +140,12 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void set_multiple_mode (struct ata_disk *, const uint16_t *id);
+
+static uint16_t find_bus_master (void);
+static void init_bus_master (struct channel *, uint16_t bm_base);
+
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -101,8 +161,11 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void)
 {
+  uint16_t bm_base;
   size_t chan_no;
 
+  bm_base = find_bus_master ();
+
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
       struct channel *c = &channels[chan_no];
@@ -126,6 +189,7 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      init_bus_master (c, bm_base != 0 ? bm_base + chan_no * 8 : 0);
 
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +200,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple = 0;
+          d->dma = false;
         }
 
       /* Register interrupt handler. */
@@ -303,12 +369,48 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  /* Transfer several sectors per interrupt if the disk can.
+     Use DMA if both the channel and the disk support it (word 49,
+     bit 8). */
+  set_multiple_mode (d, (const uint16_t *) id);
+  d->dma = c->bm_base != 0 && (((const uint16_t *) id)[49] & 0x100) != 0;
+  if (d->dma)
+    strlcat (extra_info, ", DMA", sizeof extra_info);
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
+  block_start_queue (block);
   partition_scan (block);
 }
 
+/* Enables READ/WRITE MULTIPLE on disk D with as many sectors per
+   interrupt as it supports, according to its IDENTIFY DEVICE data
+   ID.  Leaves D->multiple at 0 if the disk does not support them or
+   refuses the setting. */
+static void
+set_multiple_mode (struct ata_disk *d, const uint16_t *id)
+{
+  struct channel *c = d->channel;
+  int max = id[47] & 0xff;
+  int multiple;
+
+  /* Word 47 gives the largest number of sectors per interrupt.
+     Use the largest power of 2 that does not exceed it. */
+  if (max == 0)
+    return;
+  for (multiple = 1; multiple * 2 <= max; multiple *= 2)
+    continue;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), multiple);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if ((inb (reg_status (c)) & STA_ERR) == 0)
+    d->multiple = multiple;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -337,63 +439,418 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* PCI bus-master DMA. */
+
+/* Returns the buffer for sector I of a transfer.  A transfer uses
+   either one contiguous BUFFER or one buffer per sector in
+   BUFFERS; the other is null. */
+static inline uint8_t *
+sector_buffer (uint8_t *buffer, void *buffers[], size_t i)
+{
+  return buffers != NULL ? buffers[i] : buffer + i * BLOCK_SECTOR_SIZE;
+}
+
+/* PCI configuration space ports. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* Reads the 32-bit PCI configuration register at offset REG of
+   function FUNC of device DEV on bus BUS. */
+static uint32_t
+pci_read_config (int bus, int dev, int func, int reg)
+{
+  outl (PCI_CONFIG_ADDR, (0x80000000 | (bus << 16) | (dev << 11)
+                          | (func << 8) | (reg & 0xfc)));
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit PCI configuration register at offset
+   REG of function FUNC of device DEV on bus BUS. */
+static void
+pci_write_config (int bus, int dev, int func, int reg, uint32_t value)
+{
+  outl (PCI_CONFIG_ADDR, (0x80000000 | (bus << 16) | (dev << 11)
+                          | (func << 8) | (reg & 0xfc)));
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Searches PCI bus 0 for an IDE controller that can act as a bus
+   master with both channels at the legacy ports, enables bus
+   mastering on it, and returns its bus-master base I/O port from
+   BAR4.  Returns 0 if there is no such controller. */
+static uint16_t
+find_bus_master (void)
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        uint32_t class, bar4;
+
+        if ((pci_read_config (0, dev, func, 0x00) & 0xffff) == 0xffff)
+          {
+            /* No device or function here. */
+            if (func == 0)
+              break;
+            continue;
+          }
+
+        /* Class 01h (mass storage), subclass 01h (IDE), with
+           programming interface bit 7 (bus master) set and bits 0
+           and 2 (native-mode channels) clear. */
+        class = pci_read_config (0, dev, func, 0x08) >> 8;
+        if ((class >> 8) != 0x0101 || (class & 0x85) != 0x80)
+          continue;
+
+        /* BAR4 must be an I/O space address. */
+        bar4 = pci_read_config (0, dev, func, 0x20);
+        if ((bar4 & 1) == 0 || (bar4 & ~3u) == 0)
+          continue;
+
+        /* Enable I/O space (bit 0) and bus master (bit 2) in the
+           Command register. */
+        pci_write_config (0, dev, func, 0x04,
+                          pci_read_config (0, dev, func, 0x04) | 0x5);
+        return bar4 & 0xfffc;
+      }
+  return 0;
+}
+
+/* Sets up channel C to use bus-master DMA through the ports
+   starting at BM_BASE, or to use only PIO if BM_BASE is 0 or if
+   memory for the PRD table or bounce page is not available. */
+static void
+init_bus_master (struct channel *c, uint16_t bm_base)
+{
+  c->bm_base = 0;
+  c->prdt = NULL;
+  c->bounce = NULL;
+  if (bm_base == 0)
+    return;
+
+  c->prdt = palloc_get_page (0);
+  c->bounce = palloc_get_page (0);
+  if (c->prdt == NULL || c->bounce == NULL)
+    {
+      palloc_free_page (c->prdt);
+      palloc_free_page (c->bounce);
+      c->prdt = NULL;
+      c->bounce = NULL;
+      return;
+    }
+
+  c->bm_base = bm_base;
+  outb (reg_bm_command (c), 0);
+  outb (reg_bm_status (c), BM_STA_ERR | BM_STA_INTR);
+}
+
+/* Returns true if the bus master cannot transfer directly to or
+   from the sector buffer at P: user virtual addresses have no
+   fixed physical address, and regions must be 2-byte aligned. */
+static bool
+needs_bounce (const uint8_t *p)
+{
+  return is_user_vaddr (p) || ((uintptr_t) p & 1) != 0;
+}
+
+/* Adds the SIZE bytes at physical address ADDR to the first
+   *PRD_CNT entries of channel C's PRD table, extending the last
+   entry if possible, and updates *PRD_CNT. */
+static void
+add_prd (struct channel *c, size_t *prd_cnt, uint32_t addr, size_t size)
+{
+  while (size > 0)
+    {
+      /* Do not cross a 64 kB boundary. */
+      size_t chunk = 0x10000 - (addr & 0xffff);
+      struct prd *last = *prd_cnt > 0 ? &c->prdt[*prd_cnt - 1] : NULL;
+      size_t last_size;
+
+      if (chunk > size)
+        chunk = size;
+      last_size = last != NULL && last->size == 0 ? 0x10000 : last->size;
+      if (last != NULL && last->addr + last_size == addr
+          && (last->addr & ~0xffffu) == (addr & ~0xffffu))
+        last->size = (last_size + chunk) & 0xffff;
+      else
+        {
+          ASSERT (*prd_cnt < PRD_CNT);
+          last = &c->prdt[(*prd_cnt)++];
+          last->addr = addr;
+          last->size = chunk & 0xffff;
+        }
+      last->flags = 0;
+      addr += chunk;
+      size -= chunk;
+    }
+}
+
+/* Transfers the CNT sectors starting at SEC_NO between disk D and
+   BUFFER or BUFFERS, see sector_buffer(), by bus-master DMA.
+   Reads from the disk if WRITE is false, otherwise writes to it.
+   The caller must hold D's channel lock.  Returns true if
+   successful, false if the disk or controller reported an
+   error. */
+static bool
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+              uint8_t *buffer, void *buffers[], bool write)
+{
+  struct channel *c = d->channel;
+  size_t done = 0;
+
+  while (done < cnt)
+    {
+      size_t prd_cnt = 0;
+      size_t bounced = 0;
+      size_t cmd_cnt, i;
+      uint8_t bm_status, status;
+
+      /* Fill the PRD table, copying through the bounce page where
+         necessary, until the command or bounce page is full. */
+      for (cmd_cnt = 0; done + cmd_cnt < cnt
+             && cmd_cnt < MAX_SECTORS_PER_COMMAND; cmd_cnt++)
+        {
+          uint8_t *p = sector_buffer (buffer, buffers, done + cmd_cnt);
+
+          if (needs_bounce (p))
+            {
+              uint8_t *b;
+
+              if (bounced == BOUNCE_SECTORS)
+                break;
+              b = c->bounce + bounced++ * BLOCK_SECTOR_SIZE;
+              if (write)
+                memcpy (b, p, BLOCK_SECTOR_SIZE);
+              p = b;
+            }
+          add_prd (c, &prd_cnt, vtop (p), BLOCK_SECTOR_SIZE);
+        }
+      c->prdt[prd_cnt - 1].flags = PRD_EOT;
+
+      /* Start the transfer and wait for its completion interrupt. */
+      outl (reg_bm_prdt (c), vtop (c->prdt));
+      outb (reg_bm_command (c), write ? 0 : BM_CMD_READ);
+      outb (reg_bm_status (c), BM_STA_ERR | BM_STA_INTR);
+      select_sector (d, sec_no + done, cmd_cnt);
+      issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+      outb (reg_bm_command (c), (write ? 0 : BM_CMD_READ) | BM_CMD_START);
+      sema_down (&c->completion_wait);
+
+      /* Stop the bus master and check for errors. */
+      outb (reg_bm_command (c), 0);
+      bm_status = inb (reg_bm_status (c));
+      outb (reg_bm_status (c), BM_STA_ERR | BM_STA_INTR);
+      status = inb (reg_status (c));
+      if ((bm_status & (BM_STA_ERR | BM_STA_ACTIVE)) != 0
+          || (status & (STA_BSY | STA_DRQ | STA_ERR)) != 0)
+        return false;
+
+      /* Copy bounced sectors to their destinations. */
+      if (!write && bounced > 0)
+        for (i = 0, bounced = 0; i < cmd_cnt; i++)
+          {
+            uint8_t *p = sector_buffer (buffer, buffers, done + i);
+            if (needs_bounce (p))
+              memcpy (p, c->bounce + bounced++ * BLOCK_SECTOR_SIZE,
+                      BLOCK_SECTOR_SIZE);
+          }
+
+      done += cmd_cnt;
+    }
+  return true;
+}
+
+/* Disables DMA on disk D after a failed transfer, so that it and
+   later transfers use PIO. */
+static void
+disable_dma (struct ata_disk *d, block_sector_t sec_no)
+{
+  printf ("%s: DMA failed, sector=%"PRDSNu", falling back to PIO\n",
+          d->name, sec_no);
+  d->dma = false;
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D into BUFFER
+   or BUFFERS, see sector_buffer().  Uses DMA if it is enabled for
+   D.  Otherwise, each command transfers up to
+   MAX_SECTORS_PER_COMMAND sectors, with one interrupt per
+   D->multiple sectors if READ MULTIPLE is enabled or per sector
+   otherwise.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+read_sectors (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+              uint8_t *buffer, void *buffers[])
 {
-  struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  size_t per_intr = d->multiple > 0 ? (size_t) d->multiple : 1;
+  size_t done = 0;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  if (d->dma)
+    {
+      if (dma_transfer (d, sec_no, cnt, buffer, buffers, false))
+        done = cnt;
+      else
+        disable_dma (d, sec_no);
+    }
+  while (done < cnt)
+    {
+      size_t cmd_cnt = cnt - done;
+      size_t i;
+
+      if (cmd_cnt > MAX_SECTORS_PER_COMMAND)
+        cmd_cnt = MAX_SECTORS_PER_COMMAND;
+      select_sector (d, sec_no + done, cmd_cnt);
+      issue_pio_command (c, (d->multiple > 0 ? CMD_READ_MULTIPLE
+                             : CMD_READ_SECTOR_RETRY));
+      for (i = 0; i < cmd_cnt; i++)
+        {
+          if (i % per_intr == 0)
+            {
+              sema_down (&c->completion_wait);
+              if (!wait_while_busy (d))
+                PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                       d->name, sec_no + done + i);
+            }
+          input_sector (c, sector_buffer (buffer, buffers, done + i));
+        }
+      done += cmd_cnt;
+    }
   lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Writes the CNT sectors starting at SEC_NO to disk D from BUFFER
+   or BUFFERS, see sector_buffer().  Returns after the disk has
+   acknowledged receiving the data.  Uses DMA or PIO commands as
+   in read_sectors().
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+write_sectors (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+               const uint8_t *buffer, const void *buffers[])
 {
-  struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  size_t per_intr = d->multiple > 0 ? (size_t) d->multiple : 1;
+  size_t done = 0;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  if (d->dma)
+    {
+      if (dma_transfer (d, sec_no, cnt, (uint8_t *) buffer,
+                        (void **) buffers, true))
+        done = cnt;
+      else
+        disable_dma (d, sec_no);
+    }
+  while (done < cnt)
+    {
+      size_t cmd_cnt = cnt - done;
+      size_t i;
+
+      if (cmd_cnt > MAX_SECTORS_PER_COMMAND)
+        cmd_cnt = MAX_SECTORS_PER_COMMAND;
+      select_sector (d, sec_no + done, cmd_cnt);
+      issue_pio_command (c, (d->multiple > 0 ? CMD_WRITE_MULTIPLE
+                             : CMD_WRITE_SECTOR_RETRY));
+      for (i = 0; i < cmd_cnt; i++)
+        {
+          if (i % per_intr == 0 && !wait_while_busy (d))
+            PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                   d->name, sec_no + done + i);
+          output_sector (c, sector_buffer ((uint8_t *) buffer,
+                                           (void **) buffers, done + i));
+
+          /* The disk interrupts after each block of sectors, to ask
+             for the next one or to report completion. */
+          if ((i + 1) % per_intr == 0 || i + 1 == cmd_cnt)
+            sema_down (&c->completion_wait);
+        }
+      done += cmd_cnt;
+    }
   lock_release (&c->lock);
 }
 
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read (void *d, block_sector_t sec_no, void *buffer)
+{
+  read_sectors (d, sec_no, 1, buffer, NULL);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write (void *d, block_sector_t sec_no, const void *buffer)
+{
+  write_sectors (d, sec_no, 1, buffer, NULL);
+}
+
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER. */
+static void
+ide_read_multiple (void *d, block_sector_t sec_no, size_t cnt, void *buffer)
+{
+  read_sectors (d, sec_no, cnt, buffer, NULL);
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER. */
+static void
+ide_write_multiple (void *d, block_sector_t sec_no, size_t cnt,
+                    const void *buffer)
+{
+  write_sectors (d, sec_no, cnt, buffer, NULL);
+}
+
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFERS,
+   one sector per buffer. */
+static void
+ide_read_scatter (void *d, block_sector_t sec_no, size_t cnt,
+                  void *buffers[])
+{
+  read_sectors (d, sec_no, cnt, NULL, buffers);
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFERS,
+   one sector per buffer. */
+static void
+ide_write_gather (void *d, block_sector_t sec_no, size_t cnt,
+                  const void *buffers[])
+{
+  write_sectors (d, sec_no, cnt, NULL, buffers);
+}
+
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple,
+    ide_read_scatter,
+    ide_write_gather,
+    NULL
   };
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT, at most
+   MAX_SECTORS_PER_COMMAND, to the disk's sector selection
+   registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_SECTORS_PER_COMMAND);
 
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == MAX_SECTORS_PER_COMMAND ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
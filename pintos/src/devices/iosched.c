@@ -0,0 +1,65 @@
+#include "devices/iosched.h"
+#include <debug.h>
+#include <string.h>
+
+/* C-LOOK: serves requests in ascending sector order, starting
+   from the current head position, then jumps back to the lowest
+   queued sector.  Keeps seeks short and never starves a request
+   for more than one sweep. */
+static struct block_request *
+clook_select (struct request_queue *q)
+{
+  struct list_elem *e;
+
+  ASSERT (!list_empty (&q->by_sector));
+
+  for (e = list_begin (&q->by_sector); e != list_end (&q->by_sector);
+       e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request,
+                                            sector_elem);
+      if (r->dev_sector >= q->head)
+        return r;
+    }
+  return list_entry (list_front (&q->by_sector), struct block_request,
+                     sector_elem);
+}
+
+const struct iosched iosched_clook = { "clook", clook_select };
+
+/* Deadline: like C-LOOK, except that a request whose deadline
+   has passed is dispatched first.  Reads expire sooner than
+   writes, because a thread is usually waiting for them. */
+static struct block_request *
+deadline_select (struct request_queue *q)
+{
+  struct block_request *oldest;
+
+  ASSERT (!list_empty (&q->by_deadline));
+
+  oldest = list_entry (list_front (&q->by_deadline), struct block_request,
+                       deadline_elem);
+  if (oldest->deadline <= timer_ticks ())
+    return oldest;
+  return clook_select (q);
+}
+
+const struct iosched iosched_deadline = { "deadline", deadline_select };
+
+/* Returns the I/O scheduler with the given NAME, or a null
+   pointer if there is none. */
+const struct iosched *
+iosched_find (const char *name)
+{
+  static const struct iosched *schedulers[] =
+    {
+      &iosched_clook,
+      &iosched_deadline,
+    };
+  size_t i;
+
+  for (i = 0; i < sizeof schedulers / sizeof *schedulers; i++)
+    if (!strcmp (name, schedulers[i]->name))
+      return schedulers[i];
+  return NULL;
+}
@@ -0,0 +1,38 @@
+#ifndef DEVICES_IOSCHED_H
+#define DEVICES_IOSCHED_H
+
+#include <list.h>
+#include "devices/block.h"
+#include "devices/timer.h"
+
+/* The requests queued on a block device, kept in two orders for
+   the benefit of schedulers. */
+struct request_queue
+  {
+    struct list by_sector;      /* Ascending order of dev_sector. */
+    struct list by_deadline;    /* Ascending order of deadline. */
+    block_sector_t head;        /* Sector following the last dispatch. */
+  };
+
+/* An I/O scheduler, which decides which queued request to
+   dispatch next. */
+struct iosched
+  {
+    const char *name;           /* Name, e.g. "clook". */
+
+    /* Returns the request in nonempty queue Q to dispatch next,
+       without removing it. */
+    struct block_request *(*select) (struct request_queue *q);
+  };
+
+extern const struct iosched iosched_clook;
+extern const struct iosched iosched_deadline;
+
+const struct iosched *iosched_find (const char *name);
+
+/* How long a request may wait before the deadline scheduler
+   dispatches it out of sector order, in timer ticks. */
+#define IOSCHED_READ_EXPIRE (TIMER_FREQ / 2)
+#define IOSCHED_WRITE_EXPIRE (TIMER_FREQ * 5)
+
+#endif /* devices/iosched.h */
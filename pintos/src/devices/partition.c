@@ -317,8 +317,63 @@ partition_write (void *p_, block_sector_t sector, const void *buffer)
   block_write (p->block, p->start + sector, buffer);
 }
 
+/* Reads CNT sectors starting at SECTOR from partition P into
+   BUFFER. */
+static void
+partition_read_multiple (void *p_, block_sector_t sector, size_t cnt,
+                         void *buffer)
+{
+  struct partition *p = p_;
+  block_read_multiple (p->block, p->start + sector, cnt, buffer);
+}
+
+/* Writes CNT sectors starting at SECTOR to partition P from
+   BUFFER. */
+static void
+partition_write_multiple (void *p_, block_sector_t sector, size_t cnt,
+                          const void *buffer)
+{
+  struct partition *p = p_;
+  block_write_multiple (p->block, p->start + sector, cnt, buffer);
+}
+
+/* Reads CNT sectors starting at SECTOR from partition P into
+   BUFFERS, one sector per buffer. */
+static void
+partition_read_scatter (void *p_, block_sector_t sector, size_t cnt,
+                        void *buffers[])
+{
+  struct partition *p = p_;
+  block_read_scatter (p->block, p->start + sector, cnt, buffers);
+}
+
+/* Writes CNT sectors starting at SECTOR to partition P from
+   BUFFERS, one sector per buffer. */
+static void
+partition_write_gather (void *p_, block_sector_t sector, size_t cnt,
+                        const void *buffers[])
+{
+  struct partition *p = p_;
+  block_write_gather (p->block, p->start + sector, cnt, buffers);
+}
+
+/* Translates *SECTOR in partition P to the corresponding sector
+   of the underlying device and returns that device. */
+static struct block *
+partition_map (void *p_, block_sector_t *sector)
+{
+  struct partition *p = p_;
+  *sector += p->start;
+  return p->block;
+}
+
 static struct block_operations partition_operations =
   {
     partition_read,
-    partition_write
+    partition_write,
+    partition_read_multiple,
+    partition_write_multiple,
+    partition_read_scatter,
+    partition_write_gather,
+    partition_map
   };
@@ -1,5 +1,6 @@
 #include "devices/timer.h"
 #include <debug.h>
+#include <heap.h>
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
@@ -24,7 +25,72 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Threads blocked in timer_sleep(), ordered by wakeup_time, so
+   that the one to wake first is always at the top.  Accessed with
+   interrupts disabled, because the timer interrupt handler
+   removes threads from it. */
+static struct heap sleepers;
+
+/* Timer wheel, for events armed with timer_event_arm().
+
+   Level 0 has one slot per tick for the next WHEEL_SLOTS ticks,
+   level 1 one slot per WHEEL_SLOTS ticks for the next
+   WHEEL_SLOTS**2 ticks, and so on.  Each time level 0 comes
+   around, the events in the next slot of level 1 are moved down
+   into level 0, and likewise between the higher levels.  Thus,
+   arming and cancelling an event take constant time, and so does
+   each tick apart from the events that expire on it. */
+#define WHEEL_LEVELS 4                  /* Number of levels. */
+#define WHEEL_BITS 6                    /* Log2 of slots per level. */
+#define WHEEL_SLOTS (1 << WHEEL_BITS)   /* Slots per level. */
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+
+/* Ticks into the future that the wheel reaches.  Events further
+   out than this are kept at the far end of the top level until
+   they come within reach. */
+#define WHEEL_SPAN ((int64_t) 1 << (WHEEL_LEVELS * WHEEL_BITS))
+
+static struct list wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+static int64_t wheel_next;              /* Next tick to expire. */
+
+/* Events armed with timer_event_arm_ns(), in ascending order of
+   expiry time in PIT cycles since boot. */
+static struct list hires_events;
+
+/* Events that have expired during the current timer interrupt,
+   to be run at its end. */
+static struct list expired_events;
+
+/* Channel 0 of the PIT normally interrupts periodically, once per
+   tick.  When a high-resolution event falls due before the next
+   tick, it is instead loaded to interrupt once at the event's
+   expiry time, and then once again at the start of the next tick,
+   from which it is again made periodic.  PERIOD_START and
+   PERIOD_LEN describe what it was last loaded with. */
+#define TICK_CYCLES ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+#define MIN_ONESHOT_CYCLES 12           /* About 10 us. */
+static int64_t period_start;            /* PIT cycle it was loaded at. */
+static unsigned period_len;             /* Cycles it was loaded with. */
+static bool oneshot;                    /* Loaded in one-shot mode? */
+static bool in_timer_interrupt;         /* Running timer_interrupt()? */
+
+/* Sub-tick sleeps at least this long block on a high-resolution
+   event, and shorter ones busy-wait. */
+#define HIRES_SLEEP_MIN_NS (100 * 1000)
+
+#define NS_PER_SEC (1000 * 1000 * 1000)
+
 static intr_handler_func timer_interrupt;
+static void thread_awake (void);
+static heap_less_func wakeup_time_less_than;
+static void wheel_add (struct timer_event *);
+static void wheel_advance (void);
+static void hires_expire (int64_t now);
+static void run_expired (void);
+static int64_t timer_cycles (void);
+static void timer_program (int64_t now);
+static list_less_func expires_less_than;
+static void hires_sleep (int64_t ns);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
@@ -35,6 +101,18 @@ static void real_time_delay (int64_t num, int32_t denom);
 void
 timer_init (void)
 {
+  int level, slot;
+
+  heap_init (&sleepers, wakeup_time_less_than, NULL);
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    for (slot = 0; slot < WHEEL_SLOTS; slot++)
+      list_init (&wheel[level][slot]);
+  wheel_next = 1;
+  list_init (&hires_events);
+  list_init (&expired_events);
+  period_start = 0;
+  period_len = TICK_CYCLES;
+  oneshot = false;
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
@@ -85,15 +163,24 @@ timer_elapsed (int64_t then)
 }
 
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.  The thread is blocked in the sleepers heap until
+   the timer interrupt handler wakes it, so it uses no CPU time
+   while it sleeps. */
 void
 timer_sleep (int64_t ticks)
 {
-  int64_t start = timer_ticks ();
+  struct thread *t = thread_current ();
+  enum intr_level old_level;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks)
-    thread_yield ();
+  if (ticks <= 0)
+    return;
+
+  old_level = intr_disable ();
+  t->wakeup_time = timer_ticks () + ticks;
+  heap_push (&sleepers, &t->sleep_elem);
+  thread_block ();
+  intr_set_level (old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -159,6 +246,101 @@ timer_ndelay (int64_t ns)
   real_time_delay (ns, 1000 * 1000 * 1000);
 }
 
+/* Initializes E to call FUNC, passing E and AUX, when it expires.
+   E is not armed. */
+void
+timer_event_init (struct timer_event *e, timer_event_func *func, void *aux)
+{
+  ASSERT (e != NULL);
+  ASSERT (func != NULL);
+
+  e->pending = false;
+  e->func = func;
+  e->aux = aux;
+}
+
+/* Arms E to expire TICKS timer ticks from now, or on the next
+   tick if TICKS is less than 1.  If E was already armed, it is
+   re-armed.  Takes constant time. */
+void
+timer_event_arm (struct timer_event *e, int64_t ticks)
+{
+  enum intr_level old_level;
+
+  ASSERT (e != NULL);
+
+  old_level = intr_disable ();
+  if (e->pending)
+    list_remove (&e->elem);
+  e->expires = timer_ticks () + (ticks > 0 ? ticks : 1);
+  e->pending = true;
+  wheel_add (e);
+  intr_set_level (old_level);
+}
+
+/* Arms E to expire approximately NS nanoseconds from now.  If E
+   was already armed, it is re-armed.  Unlike timer_event_arm(),
+   this is not limited to whole ticks: if E falls due before the
+   next tick, the timer is programmed to interrupt when it does.
+   Takes time linear in the number of events armed this way. */
+void
+timer_event_arm_ns (struct timer_event *e, int64_t ns)
+{
+  int64_t cycles = (ns / NS_PER_SEC * PIT_HZ
+                    + ns % NS_PER_SEC * PIT_HZ / NS_PER_SEC);
+  enum intr_level old_level;
+  int64_t now;
+
+  ASSERT (e != NULL);
+
+  old_level = intr_disable ();
+  if (e->pending)
+    list_remove (&e->elem);
+  now = timer_cycles ();
+  e->expires = now + (cycles > 0 ? cycles : 1);
+  e->pending = true;
+  list_insert_ordered (&hires_events, &e->elem, expires_less_than, NULL);
+
+  /* Interrupt earlier than planned, if E is due first.  In the
+     timer interrupt, timer_program() will run on the way out, but
+     in any other context, including other interrupt handlers, it
+     must run now. */
+  if (!in_timer_interrupt && e->expires < period_start + period_len)
+    timer_program (now);
+  intr_set_level (old_level);
+}
+
+/* Disarms E, if it is armed.  Returns true if it was armed,
+   false if it had already run or was never armed.  Takes
+   constant time. */
+bool
+timer_event_cancel (struct timer_event *e)
+{
+  enum intr_level old_level;
+  bool was_pending;
+
+  ASSERT (e != NULL);
+
+  old_level = intr_disable ();
+  was_pending = e->pending;
+  if (was_pending)
+    {
+      list_remove (&e->elem);
+      e->pending = false;
+    }
+  intr_set_level (old_level);
+  return was_pending;
+}
+
+/* Returns true if E is armed and has not yet run. */
+bool
+timer_event_pending (const struct timer_event *e)
+{
+  ASSERT (e != NULL);
+
+  return e->pending;
+}
+
 /* Prints timer statistics. */
 void
 timer_print_stats (void)
@@ -166,12 +348,236 @@ timer_print_stats (void)
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
 }
 
-/* Timer interrupt handler. */
+/* Timer interrupt handler.  Counts a tick if channel 0 has reached
+   the start of the next one, which it always has unless it was
+   loaded to interrupt early for a high-resolution event.  Then
+   runs the events that are due, and sets up channel 0 for the
+   next interrupt. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
-  ticks++;
-  thread_tick ();
+  in_timer_interrupt = true;
+  period_start += period_len;
+  if (period_start >= (ticks + 1) * TICK_CYCLES)
+    {
+      ticks++;
+      thread_tick ();
+      thread_awake ();
+      wheel_advance ();
+    }
+  hires_expire (period_start);
+  run_expired ();
+  timer_program (period_start);
+  in_timer_interrupt = false;
+}
+
+/* Unblocks every sleeping thread whose wakeup time has come.
+   When none has, this looks only at the top of the heap, and
+   otherwise it takes time logarithmic in the number of sleepers
+   for each thread it wakes. */
+static void
+thread_awake (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (!heap_empty (&sleepers))
+    {
+      struct thread *t = heap_entry (heap_min (&sleepers),
+                                     struct thread, sleep_elem);
+      if (t->wakeup_time > ticks)
+        break;
+      heap_pop_min (&sleepers);
+      thread_unblock (t);
+    }
+}
+
+/* Returns true if thread A wakes up before thread B. */
+static bool
+wakeup_time_less_than (const struct heap_elem *a_,
+                       const struct heap_elem *b_, void *aux UNUSED)
+{
+  const struct thread *a = heap_entry (a_, struct thread, sleep_elem);
+  const struct thread *b = heap_entry (b_, struct thread, sleep_elem);
+  return a->wakeup_time < b->wakeup_time;
+}
+
+/* Puts E, which must not be in any list, into the slot of the
+   timer wheel for its expiry time.  Interrupts must be off. */
+static void
+wheel_add (struct timer_event *e)
+{
+  int64_t expires = e->expires;
+  int64_t delta = expires - wheel_next;
+  int level;
+
+  if (delta < 0)
+    {
+      expires = wheel_next;
+      delta = 0;
+    }
+  else if (delta >= WHEEL_SPAN)
+    {
+      expires = wheel_next + WHEEL_SPAN - 1;
+      delta = WHEEL_SPAN - 1;
+    }
+  for (level = 0; delta >> ((level + 1) * WHEEL_BITS) != 0; level++)
+    continue;
+  list_push_back (&wheel[level][(expires >> (level * WHEEL_BITS))
+                                & WHEEL_MASK], &e->elem);
+}
+
+/* Moves the events in slot INDEX of LEVEL of the timer wheel into
+   the lower levels.  Returns INDEX. */
+static int
+wheel_cascade (int level, int index)
+{
+  struct list *slot = &wheel[level][index];
+  struct list events;
+
+  list_init (&events);
+  list_splice (list_end (&events), list_begin (slot), list_end (slot));
+  while (!list_empty (&events))
+    wheel_add (list_entry (list_pop_front (&events),
+                           struct timer_event, elem));
+  return index;
+}
+
+/* Moves the events in the timer wheel that expire on or before
+   the current tick to expired_events. */
+static void
+wheel_advance (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (; wheel_next <= ticks; wheel_next++)
+    {
+      int index = wheel_next & WHEEL_MASK;
+      struct list *slot = &wheel[0][index];
+      int level;
+
+      if (index == 0)
+        for (level = 1; level < WHEEL_LEVELS; level++)
+          if (wheel_cascade (level, ((wheel_next >> (level * WHEEL_BITS))
+                                     & WHEEL_MASK)) != 0)
+            break;
+      list_splice (list_end (&expired_events),
+                   list_begin (slot), list_end (slot));
+    }
+}
+
+/* Moves the high-resolution events that expire on or before PIT
+   cycle NOW to expired_events. */
+static void
+hires_expire (int64_t now)
+{
+  while (!list_empty (&hires_events))
+    {
+      struct list_elem *e = list_front (&hires_events);
+      if (list_entry (e, struct timer_event, elem)->expires > now)
+        break;
+      list_remove (e);
+      list_push_back (&expired_events, e);
+    }
+}
+
+/* Runs the events in expired_events, in order. */
+static void
+run_expired (void)
+{
+  while (!list_empty (&expired_events))
+    {
+      struct timer_event *e = list_entry (list_pop_front (&expired_events),
+                                          struct timer_event, elem);
+      e->pending = false;
+      e->func (e, e->aux);
+    }
+}
+
+/* Returns the number of PIT cycles since the timer started,
+   which is precise to about a microsecond.  Interrupts must be
+   off. */
+static int64_t
+timer_cycles (void)
+{
+  unsigned count = pit_read_counter (0);
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* In one-shot mode, the counter keeps counting down past 0. */
+  return period_start + (count <= period_len ? period_len - count
+                         : period_len);
+}
+
+/* Sets up channel 0 of the PIT, at PIT cycle NOW, to interrupt
+   next at the start of the next tick or when the first
+   high-resolution event is due, whichever comes first.
+   Interrupts must be off. */
+static void
+timer_program (int64_t now)
+{
+  int64_t tick_start = ticks * TICK_CYCLES;
+  int64_t next = tick_start + TICK_CYCLES;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!list_empty (&hires_events))
+    {
+      struct timer_event *e = list_entry (list_front (&hires_events),
+                                          struct timer_event, elem);
+      if (e->expires < next)
+        next = e->expires;
+    }
+  if (next - now < MIN_ONESHOT_CYCLES)
+    next = now + MIN_ONESHOT_CYCLES;
+
+  if (now == tick_start && next == tick_start + TICK_CYCLES)
+    {
+      /* A whole tick with nothing in between: go periodic. */
+      if (oneshot)
+        {
+          pit_configure_channel (0, 2, TIMER_FREQ);
+          oneshot = false;
+        }
+    }
+  else
+    {
+      pit_configure_oneshot (0, next - now);
+      oneshot = true;
+    }
+  period_start = now;
+  period_len = next - now;
+}
+
+/* Returns true if timer event A expires before timer event B. */
+static bool
+expires_less_than (const struct list_elem *a_, const struct list_elem *b_,
+                   void *aux UNUSED)
+{
+  const struct timer_event *a = list_entry (a_, struct timer_event, elem);
+  const struct timer_event *b = list_entry (b_, struct timer_event, elem);
+  return a->expires < b->expires;
+}
+
+/* Unblocks the thread T, for hires_sleep(). */
+static void
+hires_wake (struct timer_event *e UNUSED, void *t)
+{
+  thread_unblock (t);
+}
+
+/* Blocks the current thread for approximately NS nanoseconds,
+   waking it with a high-resolution event. */
+static void
+hires_sleep (int64_t ns)
+{
+  struct timer_event e;
+  enum intr_level old_level;
+
+  timer_event_init (&e, hires_wake, thread_current ());
+  old_level = intr_disable ();
+  timer_event_arm_ns (&e, ns);
+  thread_block ();
+  intr_set_level (old_level);
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -227,6 +633,12 @@ real_time_sleep (int64_t num, int32_t denom)
          processes. */
       timer_sleep (ticks);
     }
+  else if (num * (NS_PER_SEC / denom) >= HIRES_SLEEP_MIN_NS)
+    {
+      /* Otherwise, if it's long enough to be worth switching
+         threads, block until a high-resolution event wakes us. */
+      hires_sleep (num * (NS_PER_SEC / denom));
+    }
   else
     {
       /* Otherwise, use a busy-wait loop for more accurate
@@ -1,7 +1,9 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
@@ -24,6 +26,39 @@ void timer_mdelay (int64_t milliseconds);
 void timer_udelay (int64_t microseconds);
 void timer_ndelay (int64_t nanoseconds);
 
+/* Deferred callbacks. */
+
+struct timer_event;
+
+/* Called when event E expires, with the AUX given to
+   timer_event_init(). */
+typedef void timer_event_func (struct timer_event *e, void *aux);
+
+/* A function to call at some future time.  Initialize with
+   timer_event_init(), then arm with timer_event_arm() or
+   timer_event_arm_ns().  The event must stay allocated until it
+   has run or been cancelled.
+
+   The function runs in the timer interrupt, after the tick that
+   expired it has been accounted for, with interrupts off.  Like
+   any interrupt handler it must be brief and must not sleep, but
+   it may call thread_unblock() or sema_up() and may arm its own
+   event again. */
+struct timer_event
+  {
+    struct list_elem elem;      /* In a timer wheel slot or list. */
+    int64_t expires;            /* Tick, or PIT cycle if armed in ns. */
+    bool pending;               /* Armed and not yet run? */
+    timer_event_func *func;     /* Function to call. */
+    void *aux;                  /* Passed to FUNC. */
+  };
+
+void timer_event_init (struct timer_event *, timer_event_func *, void *aux);
+void timer_event_arm (struct timer_event *, int64_t ticks);
+void timer_event_arm_ns (struct timer_event *, int64_t nanoseconds);
+bool timer_event_cancel (struct timer_event *);
+bool timer_event_pending (const struct timer_event *);
+
 void timer_print_stats (void);
 
 #endif /* devices/timer.h */
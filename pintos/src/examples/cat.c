@@ -1,6 +1,7 @@
 /* cat.c
 
-   Prints files specified on command line to the console. */
+   Prints files specified on command line to the console.  Each file
+   is streamed once, so it is opened for direct I/O. */
 
 #include <stdio.h>
 #include <syscall.h>
@@ -13,7 +14,7 @@ main (int argc, char *argv[])
 
   for (i = 1; i < argc; i++)
     {
-      int fd = open (argv[i]);
+      int fd = open_flags (argv[i], OPEN_DIRECT);
       if (fd < 0)
         {
           printf ("%s: open failed\n", argv[i]);
@@ -6,7 +6,10 @@
 
    By default, only the name of each file is printed.  If "-l" is
    given as the first argument, the type, size, and inumber of
-   each file is also printed.  This won't work until project 4. */
+   each file is also printed.  This won't work until project 4.
+
+   Reads the directory several entries per system call with
+   readdir_many(). */
 
 #include <syscall.h>
 #include <stdio.h>
@@ -24,39 +27,47 @@ list_dir (const char *dir, bool verbose)
 
   if (isdir (dir_fd))
     {
-      char name[READDIR_MAX_LEN];
+      struct readdir_entry entries[16];
+      int cnt, i;
 
       printf ("%s", dir);
       if (verbose)
         printf (" (inumber %d)", inumber (dir_fd));
       printf (":\n");
 
-      while (readdir (dir_fd, name))
-        {
-          printf ("%s", name);
-          if (verbose)
-            {
-              char full_name[128];
-              int entry_fd;
+      while ((cnt = readdir_many (dir_fd, entries, 16)) > 0)
+        for (i = 0; i < cnt; i++)
+          {
+            struct readdir_entry *e = &entries[i];
 
-              snprintf (full_name, sizeof full_name, "%s/%s", dir, name);
-              entry_fd = open (full_name);
+            printf ("%s", e->name);
+            if (verbose)
+              {
+                printf (": ");
+                if (e->is_dir)
+                  printf ("directory");
+                else
+                  {
+                    char full_name[128];
+                    int entry_fd;
 
-              printf (": ");
-              if (entry_fd != -1)
-                {
-                  if (isdir (entry_fd))
-                    printf ("directory");
-                  else
-                    printf ("%d-byte file", filesize (entry_fd));
-                  printf (", inumber %d", inumber (entry_fd));
-                }
-              else
-                printf ("open failed");
-              close (entry_fd);
-            }
-          printf ("\n");
-        }
+                    if (snprintf (full_name, sizeof full_name, "%s/%s",
+                                  dir, e->name) >= (int) sizeof full_name)
+                      printf ("name too long");
+                    else
+                      {
+                        entry_fd = open (full_name);
+                        if (entry_fd != -1)
+                          printf ("%d-byte file", filesize (entry_fd));
+                        else
+                          printf ("open failed");
+                        close (entry_fd);
+                      }
+                  }
+                printf (", inumber %d", e->inumber);
+              }
+            printf ("\n");
+          }
     }
   else
     printf ("%s: not a directory\n", dir);
@@ -1,30 +1,142 @@
 #include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "filesys/cache.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
-#define CACHE_NUM_ENTRIES 64
-#define CACHE_NUM_CHANCES 1
+/* Smallest number of cache entries, and the default share of RAM
+   given to the cache when no size is set on the command line. */
+#define CACHE_MIN_ENTRIES 64
+#define CACHE_RAM_FRACTION 16
+
+/* The write-behind flusher writes out every dirty block once per
+   CACHE_FLUSH_PERIOD ticks, or as soon as CACHE_DIRTY_HIGH_PERCENT
+   of the cache is dirty. */
+#define CACHE_FLUSH_PERIOD (2 * TIMER_FREQ)
+#define CACHE_DIRTY_HIGH_PERCENT 50
+
+/* Number of least recently used entries cache_evict () looks at
+   for a clean victim before settling for a dirty one. */
+#define CACHE_EVICT_SCAN 64
+
+/* Number of sectors that can wait for the read-ahead worker.
+   Requests beyond this are dropped. */
+#define CACHE_RA_QUEUE_SIZE 64
+
+/* Most sectors the flusher or the read-ahead worker transfer in one
+   block device request, and the number of such requests each of
+   them keeps in flight. */
+#define CACHE_RUN_MAX 32
+#define CACHE_RUN_DEPTH 4
 
 /* Cache block, each block can hold BLOCK_SECTOR_SIZE bytes of data. */
 struct cache_block
   {
     struct lock cache_block_lock;
+    struct hash_elem hash_elem;         /* Element in cache_map while valid. */
+    struct list_elem lru_elem;          /* Element in cache_lru. */
     block_sector_t disk_sector_index;
-    uint8_t data[BLOCK_SECTOR_SIZE];
+    uint8_t *data;                      /* BLOCK_SECTOR_SIZE bytes. */
 
     bool valid;
     bool dirty;
-    size_t chances_remaining;
+    bool prefetched;                    /* Read ahead and not used yet? */
   };
 
-/* Array of cache entries. */
-static struct cache_block cache[CACHE_NUM_ENTRIES];
+/* Array of cache entries and the pages backing their data. */
+static struct cache_block *cache;
+static uint8_t *cache_data;
+
+/* A dirty block seen by the flusher, recorded so that dirty blocks
+   can be written in ascending sector order. */
+struct cache_flush_entry
+  {
+    block_sector_t sector;
+    int index;
+  };
+
+/* Scratch array with room for every cache entry, used only by the
+   flusher thread. */
+static struct cache_flush_entry *cache_flush_order;
+
+/* A run of locked cache entries holding consecutive sectors, being
+   written or read with one asynchronous request. */
+struct cache_run
+  {
+    struct block_request request;
+    void *buffers[CACHE_RUN_MAX];       /* Data of each entry. */
+    int index[CACHE_RUN_MAX];           /* Index of each entry. */
+    size_t cnt;                         /* Number of entries. */
+  };
+
+/* Runs in flight, oldest first, as a ring buffer.  Each thread that
+   does asynchronous I/O has its own. */
+struct cache_run_ring
+  {
+    struct cache_run runs[CACHE_RUN_DEPTH];
+    size_t head;
+    size_t cnt;
+  };
+
+/* Rings of the flusher and of the read-ahead worker. */
+static struct cache_run_ring cache_flush_ring;
+static struct cache_run_ring cache_ra_ring;
+
+/* Number of cache entries, set by cache_configure () or derived
+   from the size of RAM by cache_init (). */
+static size_t cache_num_entries;
+
+/* Maps a disk sector to the cache block that holds it.  A block is
+   in the map exactly while it is valid.  Changing a block's mapping
+   requires both cache_update_lock and the block's cache_block_lock,
+   so holding either one is enough to read it. */
+static struct hash cache_map;
 
-/* A lock for updating cache entries. */
+/* Every cache entry in least- to most-recently used order.  Invalid
+   entries are kept at the front, so eviction normally takes the
+   first entry.  Protected by cache_update_lock. */
+static struct list cache_lru;
+
+/* A lock for cache_map, cache_lru and for choosing cache entries to
+   evict. */
 static struct lock cache_update_lock;
 
+/* Number of dirty cache entries, and the count above which the
+   flusher is woken early.  Protected by cache_dirty_lock. */
+static size_t cache_dirty_count;
+static size_t cache_dirty_high_water;
+static struct lock cache_dirty_lock;
+
+/* Upped to make the flusher thread write out dirty blocks.
+   cache_flush_pending keeps wakeups that arrive before the flusher
+   gets going from piling up into several passes. */
+static struct semaphore cache_flush_sema;
+static bool cache_flush_pending;
+
+/* Wakes the flusher every CACHE_FLUSH_PERIOD ticks. */
+static struct timer_event cache_flush_timer;
+
+/* Sectors waiting to be read ahead, as a ring buffer.  Protected by
+   cache_ra_lock; cache_ra_cond is signaled when one is added. */
+static block_sector_t cache_ra_queue[CACHE_RA_QUEUE_SIZE];
+static size_t cache_ra_head;
+static size_t cache_ra_cnt;
+static struct lock cache_ra_lock;
+static struct condition cache_ra_cond;
+
 /* Used to prevent flush on uninitialized cache if shutdown occurs before cache init. */
 static bool cache_initialized = false;
 
@@ -37,29 +149,422 @@ static struct lock cache_hit_count_lock;
 static struct lock cache_miss_count_lock;
 static struct lock cache_access_count_lock;
 
+/* Read-ahead statistics.  A prefetch hit is the first use of a block
+   that was read ahead, a prefetch miss a block that was read ahead
+   but evicted or invalidated before it was used. */
+static long long cache_prefetch_hit_count;
+static long long cache_prefetch_miss_count;
+static struct lock cache_prefetch_count_lock;
+
+static hash_hash_func cache_hash;
+static hash_less_func cache_less;
+static bool cache_allocate (size_t entry_cnt);
+static void cache_set_dirty (int index, bool dirty);
+static void cache_flush_block_index (struct block *fs_device, int index);
+static void cache_wake_flusher (void);
+static thread_func cache_flusher NO_RETURN;
+static timer_event_func cache_flush_tick;
+static thread_func cache_readahead_worker NO_RETURN;
+static void cache_drop_prefetched (int index);
+static bool cache_flush_run (struct block *fs_device, size_t *i, size_t cnt,
+                             struct cache_run *run, bool may_block);
+static void cache_prefetch_run (struct block *fs_device, block_sector_t start,
+                                size_t cnt);
+static struct cache_run *cache_run_next (struct cache_run_ring *);
+static void cache_run_submit (struct block *fs_device,
+                              struct cache_run_ring *, bool write,
+                              block_sector_t start);
+static void cache_run_finish_all (struct cache_run_ring *);
+
+/* Sets the number of cache entries.  Zero selects the default, a
+   fixed share of RAM.  Returns false, without changing anything,
+   if ENTRY_CNT sectors would not fit in RAM.  Must be called before
+   cache_init (). */
+bool
+cache_configure (size_t entry_cnt)
+{
+  ASSERT (!cache_initialized);
+
+  if (entry_cnt > init_ram_pages * (PGSIZE / BLOCK_SECTOR_SIZE))
+    return false;
+  cache_num_entries = entry_cnt;
+  return true;
+}
+
 /* Initialize the cache. */
 void
 cache_init (void)
 {
   lock_init (&cache_update_lock);
+  lock_init (&cache_dirty_lock);
+  sema_init (&cache_flush_sema, 0);
+  cache_flush_pending = false;
   lock_init (&cache_hit_count_lock);
   lock_init (&cache_miss_count_lock);
   lock_init (&cache_access_count_lock);
+  lock_init (&cache_prefetch_count_lock);
+  lock_init (&cache_ra_lock);
+  cond_init (&cache_ra_cond);
+  cache_ra_head = cache_ra_cnt = 0;
+
+  if (!hash_init (&cache_map, cache_hash, cache_less, NULL))
+    PANIC ("cache map creation failed");
+  list_init (&cache_lru);
 
   cache_hit_count = 0;
   cache_miss_count = 0;
   cache_access_count = 0;
+  cache_prefetch_hit_count = 0;
+  cache_prefetch_miss_count = 0;
+
+  /* Size the cache, giving up memory if the kernel pool is short. */
+  size_t entry_cnt = cache_num_entries;
+  if (entry_cnt == 0)
+    entry_cnt = init_ram_pages / CACHE_RAM_FRACTION * (PGSIZE / BLOCK_SECTOR_SIZE);
+  if (entry_cnt < CACHE_MIN_ENTRIES)
+    entry_cnt = CACHE_MIN_ENTRIES;
+  while (!cache_allocate (entry_cnt))
+    {
+      if (entry_cnt == CACHE_MIN_ENTRIES)
+        PANIC ("cache allocation failed");
+      entry_cnt = entry_cnt / 2 < CACHE_MIN_ENTRIES ? CACHE_MIN_ENTRIES : entry_cnt / 2;
+    }
+  cache_num_entries = entry_cnt;
+  cache_dirty_count = 0;
+  cache_dirty_high_water = cache_num_entries * CACHE_DIRTY_HIGH_PERCENT / 100;
+  printf ("cache: %zu sectors (%zu kB)\n", cache_num_entries,
+          cache_num_entries * BLOCK_SECTOR_SIZE / 1024);
 
   /* Initialize each cache block. */
-  int i;
-  for (i = 0; i < CACHE_NUM_ENTRIES; i++)
+  size_t i;
+  for (i = 0; i < cache_num_entries; i++)
     {
       cache[i].valid = false;
+      cache[i].dirty = false;
+      cache[i].prefetched = false;
+      cache[i].data = cache_data + i * BLOCK_SECTOR_SIZE;
       lock_init (&cache[i].cache_block_lock);
+      list_push_back (&cache_lru, &cache[i].lru_elem);
     }
   cache_initialized = true;
 }
 
+/* Allocates the entry array and data pages for ENTRY_CNT cache
+   entries.  Returns true if successful, false if the kernel pool
+   is too small. */
+static bool
+cache_allocate (size_t entry_cnt)
+{
+  size_t entry_pages, data_pages, order_pages;
+
+  /* Refuse sizes whose byte counts would overflow, and so look
+     small. */
+  if (entry_cnt > (SIZE_MAX - PGSIZE) / sizeof *cache
+      || entry_cnt > (SIZE_MAX - PGSIZE) / BLOCK_SECTOR_SIZE
+      || entry_cnt > (SIZE_MAX - PGSIZE) / sizeof *cache_flush_order)
+    return false;
+  entry_pages = DIV_ROUND_UP (entry_cnt * sizeof *cache, PGSIZE);
+  data_pages = DIV_ROUND_UP (entry_cnt * BLOCK_SECTOR_SIZE, PGSIZE);
+  order_pages = DIV_ROUND_UP (entry_cnt * sizeof *cache_flush_order, PGSIZE);
+
+  cache = palloc_get_multiple (PAL_ZERO, entry_pages);
+  if (cache == NULL)
+    return false;
+  cache_data = palloc_get_multiple (0, data_pages);
+  if (cache_data == NULL)
+    {
+      palloc_free_multiple (cache, entry_pages);
+      return false;
+    }
+  cache_flush_order = palloc_get_multiple (0, order_pages);
+  if (cache_flush_order == NULL)
+    {
+      palloc_free_multiple (cache_data, data_pages);
+      palloc_free_multiple (cache, entry_pages);
+      return false;
+    }
+  return true;
+}
+
+/* Starts the write-behind flusher for FS_DEVICE.  Dirty blocks are
+   written back periodically and whenever too many of them build
+   up, so that eviction rarely has to wait for a write. */
+void
+cache_start_flusher (struct block *fs_device)
+{
+  ASSERT (cache_initialized);
+
+  if (thread_create ("cache_flusher", PRI_DEFAULT, cache_flusher,
+                     fs_device) == TID_ERROR)
+    PANIC ("cannot start cache flusher");
+  timer_event_init (&cache_flush_timer, cache_flush_tick, NULL);
+  timer_event_arm (&cache_flush_timer, CACHE_FLUSH_PERIOD);
+}
+
+/* Wakes the flusher, and arms E to do so again CACHE_FLUSH_PERIOD
+   ticks from now.  Runs in the timer interrupt. */
+static void
+cache_flush_tick (struct timer_event *e, void *aux UNUSED)
+{
+  cache_wake_flusher ();
+  timer_event_arm (e, CACHE_FLUSH_PERIOD);
+}
+
+/* Asks the flusher to write out dirty blocks, unless it has
+   already been asked and has not started yet.  May be called
+   from the timer interrupt, so cache_flush_pending is checked
+   and set with interrupts off. */
+static void
+cache_wake_flusher (void)
+{
+  enum intr_level old_level = intr_disable ();
+  if (!cache_flush_pending)
+    {
+      cache_flush_pending = true;
+      sema_up (&cache_flush_sema);
+    }
+  intr_set_level (old_level);
+}
+
+/* Orders flush entries by ascending sector. */
+static int
+cache_flush_entry_compare (const void *a_, const void *b_)
+{
+  const struct cache_flush_entry *a = a_;
+  const struct cache_flush_entry *b = b_;
+  return a->sector < b->sector ? -1 : a->sector > b->sector;
+}
+
+/* Writes every dirty block to FS_DEVICE in ascending sector order
+   each time cache_flush_sema is upped. */
+static void
+cache_flusher (void *fs_device)
+{
+  for (;;)
+    {
+      size_t cnt = 0;
+      size_t i;
+
+      sema_down (&cache_flush_sema);
+      cache_flush_pending = false;
+
+      /* Bring the free map's changes into the cache first, so that
+         they are written in this pass. */
+      free_map_sync ();
+
+      /* Note which blocks look dirty.  Mappings cannot change while
+         cache_update_lock is held, but the dirty bits are only a hint
+         until each block's own lock is taken below. */
+      lock_acquire (&cache_update_lock);
+      for (i = 0; i < cache_num_entries; i++)
+        if (cache[i].valid && cache[i].dirty)
+          {
+            cache_flush_order[cnt].sector = cache[i].disk_sector_index;
+            cache_flush_order[cnt].index = i;
+            cnt++;
+          }
+      lock_release (&cache_update_lock);
+
+      qsort (cache_flush_order, cnt, sizeof *cache_flush_order,
+             cache_flush_entry_compare);
+
+      /* Keep up to CACHE_RUN_DEPTH runs in flight.  Sleeping on a
+         block's lock while holding the locks of runs in flight
+         could deadlock, so wait for those runs to finish first. */
+      for (i = 0; i < cnt; )
+        {
+          struct cache_run *run = cache_run_next (&cache_flush_ring);
+          if (!cache_flush_run (fs_device, &i, cnt, run,
+                                cache_flush_ring.cnt == 0))
+            cache_run_finish_all (&cache_flush_ring);
+        }
+      cache_run_finish_all (&cache_flush_ring);
+    }
+}
+
+/* Starts writing the dirty block in entry *I of cache_flush_order,
+   together with the blocks in the following entries that hold
+   consecutive sectors, up to CACHE_RUN_MAX of them, as a single
+   request through RUN, which must be the next run of
+   cache_flush_ring.  Advances *I past the entries handled; CNT is
+   the number of entries.  Returns false, without doing anything, if
+   MAY_BLOCK is false and the first block is in use, true
+   otherwise. */
+static bool
+cache_flush_run (struct block *fs_device, size_t *i, size_t cnt,
+                 struct cache_run *run, bool may_block)
+{
+  block_sector_t start = cache_flush_order[*i].sector;
+
+  ASSERT (run->cnt == 0);
+
+  while (*i < cnt && run->cnt < CACHE_RUN_MAX)
+    {
+      const struct cache_flush_entry *f = &cache_flush_order[*i];
+      struct cache_block *b = &cache[f->index];
+
+      if (f->sector != start + run->cnt)
+        break;
+
+      /* Wait for the first block, but extend the run only with
+         blocks that are not in use, rather than sleep while holding
+         the locks of the blocks already in it. */
+      if (run->cnt == 0 && may_block)
+        lock_acquire (&b->cache_block_lock);
+      else if (!lock_try_acquire (&b->cache_block_lock))
+        {
+          if (run->cnt == 0)
+            return false;
+          break;
+        }
+
+      if (!b->valid || !b->dirty || b->disk_sector_index != f->sector)
+        {
+          /* Written back or evicted since it was noted. */
+          lock_release (&b->cache_block_lock);
+          if (run->cnt == 0)
+            (*i)++;
+          break;
+        }
+      run->index[run->cnt] = f->index;
+      run->buffers[run->cnt] = b->data;
+      run->cnt++;
+      (*i)++;
+    }
+
+  if (run->cnt > 0)
+    cache_run_submit (fs_device, &cache_flush_ring, true, start);
+  return true;
+}
+
+/* Releases the entries of the oldest run of RING in flight once
+   it has finished, waiting for it if WAIT is true.  Returns true if
+   the run had finished, false otherwise. */
+static bool
+cache_run_finish (struct cache_run_ring *ring, bool wait)
+{
+  struct cache_run *oldest = &ring->runs[ring->head];
+  size_t k;
+
+  ASSERT (ring->cnt > 0);
+
+  if (wait)
+    block_wait (&oldest->request);
+  else if (!block_try_wait (&oldest->request))
+    return false;
+  for (k = 0; k < oldest->cnt; k++)
+    {
+      struct cache_block *b = &cache[oldest->index[k]];
+
+      /* Either way, the block now matches the disk.  A block that
+         was read is one being read ahead. */
+      cache_set_dirty (oldest->index[k], false);
+      if (!oldest->request.write)
+        b->prefetched = true;
+      lock_release (&b->cache_block_lock);
+    }
+  oldest->cnt = 0;
+  ring->head = (ring->head + 1) % CACHE_RUN_DEPTH;
+  ring->cnt--;
+  return true;
+}
+
+/* Returns the run that RING will use next.  First releases the
+   runs in flight that have finished, so that their entries are
+   not held longer than necessary, waiting for the oldest one if
+   all of them are in use. */
+static struct cache_run *
+cache_run_next (struct cache_run_ring *ring)
+{
+  while (ring->cnt > 0
+         && cache_run_finish (ring, ring->cnt == CACHE_RUN_DEPTH))
+    continue;
+  return &ring->runs[(ring->head + ring->cnt) % CACHE_RUN_DEPTH];
+}
+
+/* Starts the next run of RING, which must hold at least one locked
+   entry, as a request to write or read the sectors starting at
+   START on FS_DEVICE. */
+static void
+cache_run_submit (struct block *fs_device, struct cache_run_ring *ring,
+                  bool write, block_sector_t start)
+{
+  struct cache_run *run = &ring->runs[(ring->head + ring->cnt)
+                                      % CACHE_RUN_DEPTH];
+
+  ASSERT (ring->cnt < CACHE_RUN_DEPTH);
+  ASSERT (run->cnt > 0);
+
+  block_request_init (&run->request, write, start, run->cnt,
+                      NULL, run->buffers, NULL, NULL);
+  block_submit (fs_device, &run->request);
+  ring->cnt++;
+}
+
+/* Waits for every run of RING in flight to finish, and releases
+   their entries. */
+static void
+cache_run_finish_all (struct cache_run_ring *ring)
+{
+  while (ring->cnt > 0)
+    cache_run_finish (ring, true);
+}
+
+/* Sets the dirty bit of the block at INDEX, whose lock must be held,
+   and wakes the flusher if the number of dirty blocks just crossed
+   the high-water mark. */
+static void
+cache_set_dirty (int index, bool dirty)
+{
+  ASSERT (lock_held_by_current_thread (&cache[index].cache_block_lock));
+
+  if (cache[index].dirty == dirty)
+    return;
+  cache[index].dirty = dirty;
+
+  lock_acquire (&cache_dirty_lock);
+  if (!dirty)
+    cache_dirty_count--;
+  else if (++cache_dirty_count == cache_dirty_high_water)
+    cache_wake_flusher ();
+  lock_release (&cache_dirty_lock);
+}
+
+/* Returns a hash value for the sector held by cache block E. */
+static unsigned
+cache_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct cache_block *b = hash_entry (e, struct cache_block, hash_elem);
+  return hash_int (b->disk_sector_index);
+}
+
+/* Returns true if cache block A holds a lower sector than B. */
+static bool
+cache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct cache_block *a = hash_entry (a_, struct cache_block, hash_elem);
+  const struct cache_block *b = hash_entry (b_, struct cache_block, hash_elem);
+  return a->disk_sector_index < b->disk_sector_index;
+}
+
+/* Returns the index of the cache block mapped to sector_index, or -1
+   if sector_index is not cached.  cache_update_lock must be held. */
+static int
+cache_lookup (block_sector_t sector_index)
+{
+  struct cache_block key;
+  struct hash_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&cache_update_lock));
+
+  key.disk_sector_index = sector_index;
+  e = hash_find (&cache_map, &key.hash_elem);
+  if (e == NULL)
+    return -1;
+  return hash_entry (e, struct cache_block, hash_elem) - cache;
+}
+
 /* Writes the block at index to disk. */
 static void
 cache_flush_block_index (struct block *fs_device, int index)
@@ -69,7 +574,7 @@ cache_flush_block_index (struct block *fs_device, int index)
 
   /* Write from data to device at disk_sector_index. */
   block_write (fs_device, cache[index].disk_sector_index, cache[index].data);
-  cache[index].dirty = false;
+  cache_set_dirty (index, false);
 }
 
 /* Write entire cache to disk. */
@@ -83,8 +588,8 @@ cache_flush (struct block *fs_device)
     return;
 
   /* Write each cache block to disk */
-  int i;
-  for (i = 0; i < CACHE_NUM_ENTRIES; i++)
+  size_t i;
+  for (i = 0; i < cache_num_entries; i++)
     {
       lock_acquire (&cache[i].cache_block_lock);
       if (cache[i].valid && cache[i].dirty)
@@ -101,18 +606,29 @@ cache_invalidate (struct block *fs_device)
   if (!cache_initialized)
     return;
 
-  lock_acquire (&cache_update_lock);
-  /* Invalidate each cache entry. */
-  int i;
-  for (i = 0; i < CACHE_NUM_ENTRIES; i++)
+  /* Invalidate each cache entry.  cache_update_lock is only taken
+     while the block's own lock is held, never the other way around,
+     because cache_evict () may hold a block lock while it waits for
+     cache_update_lock. */
+  size_t i;
+  for (i = 0; i < cache_num_entries; i++)
     {
       lock_acquire (&cache[i].cache_block_lock);
-      if (cache[i].valid && cache[i].dirty)
-        cache_flush_block_index (fs_device, i);
-      cache[i].valid = false;
+      if (cache[i].valid)
+        {
+          if (cache[i].dirty)
+            cache_flush_block_index (fs_device, i);
+
+          cache_drop_prefetched (i);
+          lock_acquire (&cache_update_lock);
+          hash_delete (&cache_map, &cache[i].hash_elem);
+          list_remove (&cache[i].lru_elem);
+          list_push_front (&cache_lru, &cache[i].lru_elem);
+          cache[i].valid = false;
+          lock_release (&cache_update_lock);
+        }
       lock_release (&cache[i].cache_block_lock);
     }
-  lock_release (&cache_update_lock);
 }
 
 /* Increment cache hit count. */
@@ -142,13 +658,38 @@ cache_increment_access_count (void)
   lock_release (&cache_access_count_lock);
 }
 
-/* Stores the cache statistics in the corresponding argument references. */
+/* Clears the prefetched mark of the block at INDEX, whose lock must
+   be held, counting a prefetch miss if the block was never used. */
+static void
+cache_drop_prefetched (int index)
+{
+  ASSERT (lock_held_by_current_thread (&cache[index].cache_block_lock));
+
+  if (cache[index].prefetched)
+    {
+      cache[index].prefetched = false;
+      lock_acquire (&cache_prefetch_count_lock);
+      cache_prefetch_miss_count++;
+      lock_release (&cache_prefetch_count_lock);
+    }
+}
+
+/* Stores the cache statistics in the corresponding argument references.
+   PREFETCH_HIT_COUNT and PREFETCH_MISS_COUNT may be null. */
 int
-cache_get_stats (long long *access_count, long long *hit_count, long long *miss_count)
+cache_get_stats (long long *access_count, long long *hit_count, long long *miss_count,
+                 long long *prefetch_hit_count, long long *prefetch_miss_count)
 {
   if (access_count == NULL || hit_count == NULL || miss_count == NULL || !cache_initialized)
     return -1;
 
+  lock_acquire (&cache_prefetch_count_lock);
+  if (prefetch_hit_count != NULL)
+    *prefetch_hit_count = cache_prefetch_hit_count;
+  if (prefetch_miss_count != NULL)
+    *prefetch_miss_count = cache_prefetch_miss_count;
+  lock_release (&cache_prefetch_count_lock);
+
   lock_acquire (&cache_hit_count_lock);
   lock_acquire (&cache_miss_count_lock);
   lock_acquire (&cache_access_count_lock);
@@ -164,120 +705,198 @@ cache_get_stats (long long *access_count, long long *hit_count, long long *miss_
   return 0;
 }
 
-/* Find a cache entry to evict and return its index. */
-static int
-cache_evict (struct block *fs_device, block_sector_t sector_index)
+/* Returns the number of cache entries. */
+size_t
+cache_get_size (void)
 {
-  static size_t clock_position = 0;
-  lock_acquire (&cache_update_lock);
+  ASSERT (cache_initialized);
+  return cache_num_entries;
+}
 
-  /* Check to make sure sector_index is not already in the cache. */
+/* Prints cache statistics. */
+void
+cache_print_stats (void)
+{
+  if (!cache_initialized)
+    return;
+
+  printf ("Cache: %zu entries, %lld accesses, %lld hits, %lld misses\n",
+          cache_num_entries, cache_access_count, cache_hit_count,
+          cache_miss_count);
+  printf ("Cache: %lld prefetch hits, %lld prefetch misses\n",
+          cache_prefetch_hit_count, cache_prefetch_miss_count);
+}
+
+/* Find a cache entry to evict, map it to sector_index and return its
+   index with its cache_block_lock held.  Must be called with
+   cache_update_lock held, and sector_index must not be in the cache.
+   Releases cache_update_lock before returning.  Returns -1 if the
+   caller must retry the lookup, because every entry was busy or
+   because another thread cached sector_index in the meantime.
+
+   If every entry is busy and MAY_BLOCK is true, waits until the
+   least recently used entry is released before returning -1, so
+   that its holder, which the wait donates priority to, can make
+   progress.  The caller must then hold no other cache_block_lock.
+   If MAY_BLOCK is false, returns -1 at once instead. */
+static int
+cache_evict (struct block *fs_device, block_sector_t sector_index,
+             bool may_block)
+{
+  struct list_elem *e;
+  int scanned;
   int i;
-  for (i = 0; i < CACHE_NUM_ENTRIES; i++)
+
+  ASSERT (lock_held_by_current_thread (&cache_update_lock));
+
+  /* Evict the least recently used clean entry, so that the caller
+     does not have to wait for a write.  Entries whose lock is held
+     are in use, so skip them instead of sleeping on them while
+     holding cache_update_lock. */
+  for (e = list_begin (&cache_lru), scanned = 0;
+       e != list_end (&cache_lru) && scanned < CACHE_EVICT_SCAN;
+       e = list_next (e), scanned++)
     {
-      lock_acquire (&cache[i].cache_block_lock);
-      if (cache[i].valid && (cache[i].disk_sector_index == sector_index))
+      struct cache_block *b = list_entry (e, struct cache_block, lru_elem);
+      if (lock_try_acquire (&b->cache_block_lock))
         {
-          lock_release (&cache_update_lock);
-          return (-i) - 1;
+          if (!b->valid || !b->dirty)
+            break;
+          lock_release (&b->cache_block_lock);
         }
-      lock_release (&cache[i].cache_block_lock);
     }
 
-  /* Perform clock algorithm to find slot to evict. */
-  while (true)
+  /* Every entry near the front is dirty.  Get the flusher going and
+     fall back to the least recently used entry that is not busy. */
+  if (e == list_end (&cache_lru) || scanned == CACHE_EVICT_SCAN)
     {
-      i = clock_position;
-      clock_position++;
-      clock_position %= CACHE_NUM_ENTRIES;
-
-      lock_acquire (&cache[i].cache_block_lock);
+      cache_wake_flusher ();
+      for (e = list_begin (&cache_lru); e != list_end (&cache_lru);
+           e = list_next (e))
+        if (lock_try_acquire (&list_entry (e, struct cache_block,
+                                           lru_elem)->cache_block_lock))
+          break;
+    }
 
-      if (!cache[i].valid)
+  if (e == list_end (&cache_lru))
+    {
+      /* Every entry is busy.  Sleep until one is free rather than
+         yield, which would spin forever ahead of the holders if we
+         have a higher priority than they do. */
+      struct cache_block *b = list_entry (list_begin (&cache_lru),
+                                          struct cache_block, lru_elem);
+      lock_release (&cache_update_lock);
+      if (may_block)
         {
-          lock_release (&cache_update_lock);
-          return i;
+          lock_acquire (&b->cache_block_lock);
+          lock_release (&b->cache_block_lock);
         }
+      return -1;
+    }
+  i = list_entry (e, struct cache_block, lru_elem) - cache;
+  list_remove (e);
+  list_push_back (&cache_lru, e);
 
-      if (cache[i].chances_remaining == 0)
-        break;
+  if (cache[i].valid && cache[i].dirty)
+    {
+      /* Write dirty block back to disk.  The block stays mapped while
+         it is written, so readers of its old sector wait on its lock
+         instead of reading stale data from disk. */
+      lock_release (&cache_update_lock);
+      cache_flush_block_index (fs_device, i);
+      lock_acquire (&cache_update_lock);
 
-      cache[i].chances_remaining--;
-      lock_release (&cache[i].cache_block_lock);
+      if (cache_lookup (sector_index) >= 0)
+        {
+          lock_release (&cache_update_lock);
+          lock_release (&cache[i].cache_block_lock);
+          return -1;
+        }
     }
-    
-  /* Cache entry is valid if it got to this point. */
+
+  /* Remap the entry.  Its contents are filled in by cache_replace ()
+     before its lock is released. */
+  cache_drop_prefetched (i);
+  if (cache[i].valid)
+    hash_delete (&cache_map, &cache[i].hash_elem);
+  cache[i].valid = true;
+  cache[i].disk_sector_index = sector_index;
+  hash_insert (&cache_map, &cache[i].hash_elem);
 
   lock_release (&cache_update_lock);
-  /* Write dirty block back to disk. */
-  if (cache[i].dirty)
-    cache_flush_block_index (fs_device, i);
-  cache[i].valid = false;
   return i;
 }
 
-/* Replace the cache entry at index to contain data from sector_index. */
+/* Fill the cache entry at index, just mapped by cache_evict (), with
+   the contents of its disk sector. */
 static void
-cache_replace (struct block *fs_device, int index, block_sector_t sector_index,
-               bool is_whole_block_write)
+cache_replace (struct block *fs_device, int index, bool is_whole_block_write)
 {
   ASSERT (lock_held_by_current_thread (&cache[index].cache_block_lock));
-  ASSERT (cache[index].valid == false);
+  ASSERT (cache[index].valid == true);
 
   /* Read in and write from device at disk_sector_index to data.
      Optmization: do not read in from disk if writing a whole block. */
   if (!is_whole_block_write)
-    block_read (fs_device, sector_index, cache[index].data);
-  
-  cache[index].valid = true;
-  cache[index].dirty = false;
-  cache[index].disk_sector_index = sector_index;
-  cache[index].chances_remaining = CACHE_NUM_CHANCES;
+    block_read (fs_device, cache[index].disk_sector_index, cache[index].data);
+
+  cache_set_dirty (index, false);
 }
 
-/* Returns the index in the cache corresponding to the block holding sector_index. */
+/* Returns the index in the cache corresponding to the block holding
+   sector_index, with its cache_block_lock held.  A hit costs one
+   cache_map probe and exactly one cache_block_lock acquisition. */
 static int
 cache_get_block_index (struct block *fs_device, block_sector_t sector_index,
                        bool is_whole_block_write)
 {
   cache_increment_access_count ();
-  /* Check if sector_index is in cache. */
-  int i;
-  for (i = 0; i < CACHE_NUM_ENTRIES; i++)
+
+  while (true)
     {
-      lock_acquire (&cache[i].cache_block_lock);
-      if (cache[i].valid && (cache[i].disk_sector_index == sector_index))
+      lock_acquire (&cache_update_lock);
+      int i = cache_lookup (sector_index);
+
+      if (i >= 0)
         {
-          /* Cache hit. */
-          cache_increment_hit_count ();
-          break;
+          /* Cache hit.  Wait for the block outside cache_update_lock,
+             then make sure it was not evicted in the meantime. */
+          list_remove (&cache[i].lru_elem);
+          list_push_back (&cache_lru, &cache[i].lru_elem);
+          lock_release (&cache_update_lock);
+          lock_acquire (&cache[i].cache_block_lock);
+          if (cache[i].valid && cache[i].disk_sector_index == sector_index)
+            {
+              /* The first use of a block that was read ahead still
+                 counts as a miss, so that the hit rate reflects reuse
+                 alone; read-ahead is credited with a prefetch hit. */
+              if (cache[i].prefetched)
+                {
+                  cache[i].prefetched = false;
+                  cache_increment_miss_count ();
+                  lock_acquire (&cache_prefetch_count_lock);
+                  cache_prefetch_hit_count++;
+                  lock_release (&cache_prefetch_count_lock);
+                }
+              else
+                cache_increment_hit_count ();
+              return i;
+            }
+          lock_release (&cache[i].cache_block_lock);
+          continue;
         }
 
-      lock_release (&cache[i].cache_block_lock);
-    }
-
-  /* Evict if sector_index is not in cache. */
-  if (i == CACHE_NUM_ENTRIES)
-    {
       /* Cache miss.
-         cache_evict () acquires cache_block_lock at index i. */
-      i = cache_evict (fs_device, sector_index); 
+         cache_evict () acquires cache_block_lock at index i and
+         releases cache_update_lock. */
+      i = cache_evict (fs_device, sector_index, true);
       if (i >= 0)
         {
-          /* Found a block to evict. */
           cache_increment_miss_count ();
-          cache_replace (fs_device, i, sector_index, is_whole_block_write);
-        }
-      else
-        {
-          /* Sector index was found in the cache so it was a cache hit. */
-          cache_increment_hit_count ();
-          i = - (i + 1);
+          cache_replace (fs_device, i, is_whole_block_write);
+          return i;
         }
     }
-
-  ASSERT (lock_held_by_current_thread (&cache[i].cache_block_lock));
-  return i;
 }
 
 /* Read chunk_size bytes of data from cache starting from sector_index at position offest,
@@ -298,10 +917,64 @@ cache_read (struct block *fs_device, block_sector_t sector_index, void *destinat
   ASSERT (cache[i].valid == true);
 
   memcpy (destination, cache[i].data + offset, chunk_size);
-  cache[i].chances_remaining = CACHE_NUM_CHANCES;
   lock_release (&cache[i].cache_block_lock);
 }
 
+/* Read the cnt whole sectors starting at sector_index into destination,
+   bypassing the cache for sectors that are not cached.  A cached copy
+   may be newer than the disk, so it is used if there is one.  A sector
+   that is not cached is up to date on disk, because blocks stay mapped
+   while they are written back.  Each stretch of sectors that are not
+   cached is read with a single request, of up to a page at a time.
+   Bypassed reads are not counted as accesses.
+
+   DESTINATION may be in user memory, which the block device's
+   dispatcher thread cannot reach, so the disk is read into a page
+   of kernel memory and copied to DESTINATION from there.  If no
+   page can be had, the sectors are read through the cache. */
+void
+cache_read_direct (struct block *fs_device, block_sector_t sector_index,
+                   size_t cnt, void *destination)
+{
+  const size_t bounce_sectors = PGSIZE / BLOCK_SECTOR_SIZE;
+  uint8_t *dst = destination;
+  uint8_t *bounce;
+  size_t n;
+
+  ASSERT (fs_device != NULL);
+  ASSERT (cache_initialized == true);
+
+  bounce = palloc_get_page (0);
+  while (cnt > 0)
+    {
+      n = 0;
+      if (bounce != NULL)
+        {
+          lock_acquire (&cache_update_lock);
+          while (n < cnt && n < bounce_sectors
+                 && cache_lookup (sector_index + n) < 0)
+            n++;
+          lock_release (&cache_update_lock);
+        }
+
+      if (n == 0)
+        {
+          cache_read (fs_device, sector_index, dst, 0, BLOCK_SECTOR_SIZE);
+          n = 1;
+        }
+      else
+        {
+          block_read_multiple (fs_device, sector_index, n, bounce);
+          memcpy (dst, bounce, n * BLOCK_SECTOR_SIZE);
+        }
+
+      sector_index += n;
+      dst += n * BLOCK_SECTOR_SIZE;
+      cnt -= n;
+    }
+  palloc_free_page (bounce);
+}
+
 /* Write chunk_size bytes of data into cache starting from sector_index at position offest,
    from source. */
 void
@@ -324,7 +997,138 @@ cache_write (struct block *fs_device, block_sector_t sector_index, void *source,
   ASSERT (cache[i].valid == true);
 
   memcpy (cache[i].data + offset, source, chunk_size);
-  cache[i].dirty = true;
-  cache[i].chances_remaining = CACHE_NUM_CHANCES;
+  cache_set_dirty (i, true);
   lock_release (&cache[i].cache_block_lock);
 }
+
+/* Queues SECTOR to be read into the cache in the background.  The
+   request is dropped if the read-ahead queue is full. */
+void
+cache_readahead (block_sector_t sector)
+{
+  ASSERT (cache_initialized);
+
+  lock_acquire (&cache_ra_lock);
+  if (cache_ra_cnt < CACHE_RA_QUEUE_SIZE)
+    {
+      cache_ra_queue[(cache_ra_head + cache_ra_cnt) % CACHE_RA_QUEUE_SIZE]
+        = sector;
+      cache_ra_cnt++;
+      cond_signal (&cache_ra_cond, &cache_ra_lock);
+    }
+  lock_release (&cache_ra_lock);
+}
+
+/* Starts the thread that serves cache_readahead () requests from
+   FS_DEVICE. */
+void
+cache_start_readahead (struct block *fs_device)
+{
+  ASSERT (cache_initialized);
+
+  if (thread_create ("cache_readahead", PRI_DEFAULT, cache_readahead_worker,
+                     fs_device) == TID_ERROR)
+    PANIC ("cannot start cache read-ahead");
+}
+
+/* Reads queued sectors into the cache.  Queued sectors that are
+   consecutive on disk are read with a single request, and several
+   such requests may be in flight at once. */
+static void
+cache_readahead_worker (void *fs_device)
+{
+  for (;;)
+    {
+      block_sector_t start;
+      size_t cnt;
+
+      lock_acquire (&cache_ra_lock);
+      while (cache_ra_cnt == 0)
+        {
+          /* Do not keep entries locked while idle. */
+          if (cache_ra_ring.cnt > 0)
+            {
+              lock_release (&cache_ra_lock);
+              cache_run_finish_all (&cache_ra_ring);
+              lock_acquire (&cache_ra_lock);
+              continue;
+            }
+          cond_wait (&cache_ra_cond, &cache_ra_lock);
+        }
+      start = cache_ra_queue[cache_ra_head];
+      cnt = 0;
+      do
+        {
+          cache_ra_head = (cache_ra_head + 1) % CACHE_RA_QUEUE_SIZE;
+          cache_ra_cnt--;
+          cnt++;
+        }
+      while (cache_ra_cnt > 0 && cnt < CACHE_RUN_MAX
+             && cache_ra_queue[cache_ra_head] == start + cnt);
+      lock_release (&cache_ra_lock);
+
+      cache_prefetch_run (fs_device, start, cnt);
+    }
+}
+
+/* Reads the CNT sectors starting at START into the cache, marking
+   them prefetched.  Sectors that are already cached are left alone,
+   and reads ahead do not count as cache accesses.  Each stretch of
+   sectors that are not cached is read with a single request. */
+static void
+cache_prefetch_run (struct block *fs_device, block_sector_t start, size_t cnt)
+{
+  struct cache_run *run = cache_run_next (&cache_ra_ring);
+  size_t k;
+
+  ASSERT (cnt <= CACHE_RUN_MAX);
+
+  for (k = 0; k <= cnt; k++)
+    {
+      int i = -1;
+
+      /* Map sector START + K to a cache entry, unless it is cached
+         already.  The entries of the sectors before it stay locked
+         until they are read, so cache_evict () must not sleep on
+         other entries: only take free ones.  If our own runs in
+         flight hold the only entries that could be taken, release
+         one.  If nothing of ours is in flight, give up on the rest
+         of the stretch, since read-ahead is only a hint. */
+      while (k < cnt)
+        {
+          lock_acquire (&cache_update_lock);
+          if (cache_lookup (start + k) >= 0)
+            {
+              lock_release (&cache_update_lock);
+              break;
+            }
+
+          /* cache_evict () acquires cache_block_lock at index i and
+             releases cache_update_lock. */
+          i = cache_evict (fs_device, start + k, false);
+          if (i >= 0)
+            break;
+          if (cache_ra_ring.cnt == 0)
+            {
+              k = cnt;
+              break;
+            }
+          cache_run_finish (&cache_ra_ring, true);
+        }
+
+      if (i >= 0)
+        {
+          run->index[run->cnt] = i;
+          run->buffers[run->cnt] = cache[i].data;
+          run->cnt++;
+        }
+      else if (run->cnt > 0)
+        {
+          /* A cached sector, or the end, closes the current stretch,
+             which is read while the next is mapped. */
+          cache_run_submit (fs_device, &cache_ra_ring, false,
+                            start + k - run->cnt);
+          run = cache_run_next (&cache_ra_ring);
+        }
+    }
+}
@@ -1,26 +1,54 @@
 #ifndef FILESYS_CACHE_H
 #define FILESYS_CACHE_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include "off_t.h"
 #include "devices/block.h"
 
+/* Set the number of cache entries, 0 for the default.  Returns
+   false if there is not that much RAM. */
+bool cache_configure (size_t entry_cnt);
+
 /* Initialize cache. */
 void cache_init (void);
 
+/* Start the thread that writes dirty blocks back in the background. */
+void cache_start_flusher (struct block *fs_device);
+
+/* Start the thread that reads sectors ahead in the background, and
+   queue a sector for it. */
+void cache_start_readahead (struct block *fs_device);
+void cache_readahead (block_sector_t sector);
+
 /* Invalidate the entire cache by invalidating all its entries. */
 void cache_invalidate (struct block *fs_device);
 
 /* Write entire cache to disk. */
 void cache_flush (struct block *fs_device);
 
-/* Stores the cache statistics in the corresponding argument references. */
-int cache_get_stats (long long *access_count, long long *hit_count, long long *miss_count);
+/* Stores the cache statistics in the corresponding argument references.
+   The read-ahead counts are optional and may be null. */
+int cache_get_stats (long long *access_count, long long *hit_count, long long *miss_count,
+                     long long *prefetch_hit_count, long long *prefetch_miss_count);
+
+/* Returns the number of cache entries. */
+size_t cache_get_size (void);
+
+/* Prints the cache statistics. */
+void cache_print_stats (void);
 
 /* Read chunk_size bytes of data from cache starting from sector_index at position offest,
    into destination. */
 void cache_read (struct block *fs_device, block_sector_t sector_index, void *destination,
                  off_t offset, int chunk_size);
 
+/* Read cnt whole sectors starting at sector_index into destination, from the
+   cache for sectors that are cached and straight from disk, without caching
+   them, otherwise. */
+void cache_read_direct (struct block *fs_device, block_sector_t sector_index,
+                        size_t cnt, void *destination);
+
 /* Write chunk_size bytes of data into cache starting from sector_index at position offest,
    from source. */
 void cache_write (struct block *fs_device, block_sector_t sector_index, void *source,
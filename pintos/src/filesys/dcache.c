@@ -0,0 +1,261 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "filesys/inode.h"
+#include "threads/synch.h"
+
+/* Number of names cached. */
+#define DCACHE_SIZE 256
+
+/* A cached name: what NAME is in the directory whose inode is in
+   sector PARENT. */
+struct dcache_entry
+  {
+    struct hash_elem hash_elem;         /* Element in dcache_map if used. */
+    struct list_elem lru_elem;          /* Element in dcache_lru. */
+    bool in_use;                        /* In dcache_map? */
+    block_sector_t parent;              /* Directory's inode sector. */
+    char name[NAME_MAX + 1];            /* Name within PARENT. */
+    bool negative;                      /* Cached as absent? */
+    block_sector_t sector;              /* Inode sector, unless NEGATIVE. */
+    bool is_dir;                        /* Directory?  Unless NEGATIVE. */
+  };
+
+static struct dcache_entry dcache[DCACHE_SIZE];
+
+/* Maps (parent, name) to entries in use. */
+static struct hash dcache_map;
+
+/* All entries, least recently used first.  Unused entries are kept
+   at the front, so that they are reused first. */
+static struct list dcache_lru;
+
+/* Protects the above, dcache_seq, and the statistics. */
+static struct lock dcache_lock;
+
+/* Number of invalidations so far.  A directory read that began
+   before an invalidation may be out of date, so dcache_add() and
+   dcache_add_negative() ignore it. */
+static unsigned dcache_seq;
+
+/* Statistics. */
+static long long dcache_hit_cnt;        /* Lookups of present names. */
+static long long dcache_negative_cnt;   /* Lookups of absent names. */
+static long long dcache_miss_cnt;       /* Lookups of uncached names. */
+
+static hash_hash_func dcache_hash;
+static hash_less_func dcache_less;
+static struct dcache_entry *find (block_sector_t parent, const char *name);
+static void insert (struct inode *parent, const char *name, bool negative,
+                    block_sector_t sector, bool is_dir, unsigned seq);
+static void discard (struct dcache_entry *);
+
+/* Initializes the name cache. */
+void
+dcache_init (void)
+{
+  size_t i;
+
+  lock_init (&dcache_lock);
+  if (!hash_init (&dcache_map, dcache_hash, dcache_less, NULL))
+    PANIC ("name cache initialization failed");
+  list_init (&dcache_lru);
+  for (i = 0; i < DCACHE_SIZE; i++)
+    {
+      dcache[i].in_use = false;
+      list_push_back (&dcache_lru, &dcache[i].lru_elem);
+    }
+}
+
+/* Looks up NAME in the directory whose inode is in sector PARENT.
+   On a hit, stores the sector of NAME's inode into *SECTORP and
+   whether it is a directory into *IS_DIRP, if IS_DIRP is
+   non-null.  On a miss, stores into *SEQP the value to pass to
+   dcache_add() or dcache_add_negative(). */
+enum dcache_result
+dcache_lookup (block_sector_t parent, const char *name,
+               block_sector_t *sectorp, bool *is_dirp, unsigned *seqp)
+{
+  struct dcache_entry *e;
+  enum dcache_result result;
+
+  lock_acquire (&dcache_lock);
+  e = find (parent, name);
+  if (e == NULL)
+    {
+      *seqp = dcache_seq;
+      dcache_miss_cnt++;
+      result = DCACHE_MISS;
+    }
+  else
+    {
+      list_remove (&e->lru_elem);
+      list_push_back (&dcache_lru, &e->lru_elem);
+      if (e->negative)
+        {
+          dcache_negative_cnt++;
+          result = DCACHE_NEGATIVE;
+        }
+      else
+        {
+          *sectorp = e->sector;
+          if (is_dirp != NULL)
+            *is_dirp = e->is_dir;
+          dcache_hit_cnt++;
+          result = DCACHE_HIT;
+        }
+    }
+  lock_release (&dcache_lock);
+
+  return result;
+}
+
+/* Caches that NAME in directory PARENT has its inode in sector
+   SECTOR, and whether it is a directory, as read after
+   dcache_lookup() returned SEQ. */
+void
+dcache_add (struct inode *parent, const char *name, block_sector_t sector,
+            bool is_dir, unsigned seq)
+{
+  insert (parent, name, false, sector, is_dir, seq);
+}
+
+/* Caches that directory PARENT does not contain NAME, as read
+   after dcache_lookup() returned SEQ. */
+void
+dcache_add_negative (struct inode *parent, const char *name, unsigned seq)
+{
+  insert (parent, name, true, 0, false, seq);
+}
+
+/* Forgets what is cached about NAME in the directory whose inode
+   is in sector PARENT.  Must be called after the directory
+   changes. */
+void
+dcache_invalidate (block_sector_t parent, const char *name)
+{
+  struct dcache_entry *e;
+
+  lock_acquire (&dcache_lock);
+  dcache_seq++;
+  e = find (parent, name);
+  if (e != NULL)
+    discard (e);
+  lock_release (&dcache_lock);
+}
+
+/* Forgets every name cached in the directory whose inode is in
+   sector PARENT.  Must be called after the directory is marked
+   removed, so that nothing is cached in it again before its
+   sector is reused. */
+void
+dcache_invalidate_dir (block_sector_t parent)
+{
+  size_t i;
+
+  lock_acquire (&dcache_lock);
+  dcache_seq++;
+  for (i = 0; i < DCACHE_SIZE; i++)
+    if (dcache[i].in_use && dcache[i].parent == parent)
+      discard (&dcache[i]);
+  lock_release (&dcache_lock);
+}
+
+/* Prints name cache statistics. */
+void
+dcache_print_stats (void)
+{
+  printf ("Name cache: %lld hits, %lld negative hits, %lld misses\n",
+          dcache_hit_cnt, dcache_negative_cnt, dcache_miss_cnt);
+}
+
+/* Caches what NAME is in directory PARENT, replacing the least
+   recently used entry, unless PARENT has been removed or the cache
+   was invalidated since SEQ. */
+static void
+insert (struct inode *parent, const char *name, bool negative,
+        block_sector_t sector, bool is_dir, unsigned seq)
+{
+  block_sector_t parent_sector = inode_get_inumber (parent);
+  struct dcache_entry *e;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  if (seq == dcache_seq && !inode_is_removed (parent))
+    {
+      e = find (parent_sector, name);
+      if (e == NULL)
+        {
+          e = list_entry (list_front (&dcache_lru), struct dcache_entry,
+                          lru_elem);
+          if (e->in_use)
+            hash_delete (&dcache_map, &e->hash_elem);
+          e->parent = parent_sector;
+          strlcpy (e->name, name, sizeof e->name);
+          hash_insert (&dcache_map, &e->hash_elem);
+          e->in_use = true;
+        }
+      e->negative = negative;
+      e->sector = sector;
+      e->is_dir = is_dir;
+      list_remove (&e->lru_elem);
+      list_push_back (&dcache_lru, &e->lru_elem);
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Returns the entry for NAME in directory PARENT, or a null
+   pointer if there is none.  dcache_lock must be held. */
+static struct dcache_entry *
+find (block_sector_t parent, const char *name)
+{
+  struct dcache_entry key;
+  struct hash_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  key.parent = parent;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dcache_map, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dcache_entry, hash_elem) : NULL;
+}
+
+/* Removes E from the cache and makes it the next entry reused.
+   dcache_lock must be held. */
+static void
+discard (struct dcache_entry *e)
+{
+  hash_delete (&dcache_map, &e->hash_elem);
+  e->in_use = false;
+  list_remove (&e->lru_elem);
+  list_push_front (&dcache_lru, &e->lru_elem);
+}
+
+/* Returns a hash value for the name cached by entry E. */
+static unsigned
+dcache_hash (const struct hash_elem *e_, void *aux UNUSED)
+{
+  const struct dcache_entry *e = hash_entry (e_, struct dcache_entry,
+                                             hash_elem);
+  return hash_string (e->name) ^ hash_int (e->parent);
+}
+
+/* Returns true if entry A precedes entry B. */
+static bool
+dcache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dcache_entry *a = hash_entry (a_, struct dcache_entry,
+                                             hash_elem);
+  const struct dcache_entry *b = hash_entry (b_, struct dcache_entry,
+                                             hash_elem);
+  if (a->parent != b->parent)
+    return a->parent < b->parent;
+  return strcmp (a->name, b->name) < 0;
+}
@@ -0,0 +1,36 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+struct inode;
+
+/* Result of looking up a name in the name cache. */
+enum dcache_result
+  {
+    DCACHE_MISS,                /* Not cached. */
+    DCACHE_HIT,                 /* Cached as present. */
+    DCACHE_NEGATIVE             /* Cached as absent. */
+  };
+
+void dcache_init (void);
+
+/* Looking up names.  On a miss, *SEQP is set to pass to
+   dcache_add() or dcache_add_negative() with what the directory
+   itself says about the name. */
+enum dcache_result dcache_lookup (block_sector_t parent, const char *name,
+                                  block_sector_t *sectorp, bool *is_dirp,
+                                  unsigned *seqp);
+void dcache_add (struct inode *parent, const char *name,
+                 block_sector_t sector, bool is_dir, unsigned seq);
+void dcache_add_negative (struct inode *parent, const char *name,
+                          unsigned seq);
+
+/* Invalidation, after directories change. */
+void dcache_invalidate (block_sector_t parent, const char *name);
+void dcache_invalidate_dir (block_sector_t parent);
+
+void dcache_print_stats (void);
+
+#endif /* filesys/dcache.h */
@@ -1,7 +1,11 @@
 #include "filesys/directory.h"
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include <round.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
@@ -13,7 +17,6 @@ struct dir
   {
     struct inode *inode;                /* Backing store. */
     off_t pos;                          /* Current position. */
-    struct lock dir_lock;
   };
 
 /* A single directory entry. */
@@ -24,6 +27,91 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* Hashed directories.
+
+   A directory starts out as a linear array of entries, the first
+   of which is not in use and holds the parent directory's sector.
+   When a linear directory fills up past DIR_LINEAR_MAX bytes, it
+   is converted to a hashed directory, whose entries are kept in
+   leaf blocks by hash of name.  Block 0 of a hashed directory is a
+   dir_root that maps ranges of hashes to leaf blocks, directly or
+   through a second level of dir_index blocks, much like the htree
+   directories of ext3.
+
+   The root starts with the same parent entry as a linear
+   directory, so ".." is found the same way in both.  A hashed
+   directory is recognized by DIR_HASH_MAGIC in place of the
+   inode_sector of a linear directory's second entry, which is
+   always a sector number or 0. */
+#define DIR_LINEAR_MAX (2 * BLOCK_SECTOR_SIZE)
+#define DIR_HASH_MAGIC 0x48534844       /* "DHSH". */
+#define DIR_LEAF_MAGIC 0x464c4844       /* "DHLF". */
+#define DIR_INDEX_MAGIC 0x58494844      /* "DHIX". */
+
+/* Entries per block of each kind. */
+#define DIR_ROOT_ENTRIES 59
+#define DIR_INDEX_ENTRIES 62
+#define DIR_LEAF_ENTRIES 25
+
+/* Maps hashes from HASH up to the next entry's hash to BLOCK. */
+struct dir_index_entry
+  {
+    uint32_t hash;                      /* Lowest hash. */
+    uint32_t block;                     /* Block within the directory. */
+  };
+
+/* Block 0 of a hashed directory. */
+struct dir_root
+  {
+    struct dir_entry parent;            /* Parent directory, not in use. */
+    uint32_t magic;                     /* DIR_HASH_MAGIC. */
+    uint32_t levels;                    /* 1 if ENTRIES point to leaves,
+                                           2 if to dir_index blocks. */
+    uint32_t block_cnt;                 /* Blocks in use, including root. */
+    uint32_t cnt;                       /* Number of ENTRIES in use. */
+    struct dir_index_entry entries[DIR_ROOT_ENTRIES];
+    uint32_t unused;
+  };
+
+/* Second-level index block of a hashed directory. */
+struct dir_index
+  {
+    uint32_t cnt;                       /* Number of ENTRIES in use. */
+    struct dir_index_entry entries[DIR_INDEX_ENTRIES];
+    uint32_t unused[2];
+    uint32_t magic;                     /* DIR_INDEX_MAGIC. */
+  };
+
+/* Leaf block of a hashed directory. */
+struct dir_leaf
+  {
+    struct dir_entry entries[DIR_LEAF_ENTRIES];
+    uint32_t unused[2];
+    uint32_t magic;                     /* DIR_LEAF_MAGIC. */
+  };
+
+/* The blocks of a hashed directory on the way from its root to the
+   leaf for one hash, for lookup and insertion. */
+struct dir_path
+  {
+    struct dir_root root;
+    size_t root_pos;                    /* Entry taken in ROOT. */
+    struct dir_index index;             /* Only if ROOT has 2 levels. */
+    uint32_t index_no;                  /* Block number of INDEX. */
+    size_t index_pos;                   /* Entry taken in INDEX. */
+    struct dir_leaf leaf;
+    uint32_t leaf_no;                   /* Block number of LEAF. */
+  };
+
+static bool dir_is_hashed (struct inode *);
+static bool dir_convert (struct inode *);
+static bool hashed_lookup (struct inode *, const char *name,
+                           struct dir_entry *ep, off_t *ofsp);
+static bool hashed_add (struct inode *, const struct dir_entry *);
+static bool next_entry (struct inode *, off_t *pos, struct dir_entry *ep);
+static size_t read_entries (struct inode *, off_t *pos,
+                             struct dir_entry entries[], off_t *nextp);
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool
@@ -34,11 +122,12 @@ dir_create (block_sector_t sector, size_t entry_cnt)
     {
       struct dir *curr_dir = dir_open (inode_open (sector));
       struct dir_entry e;
+      memset (&e, 0, sizeof e);
       e.inode_sector = sector;
       e.in_use = false;
 
       /* Acquire dir lock */
-      dir_acquire_lock (curr_dir);
+      dir_acquire_lock (curr_dir, true);
       if (inode_write_at (dir_get_inode (curr_dir), &e, sizeof (e), 0) != sizeof (e))
         success = false;
 
@@ -59,7 +148,6 @@ dir_open (struct inode *inode)
     {
       dir->inode = inode;
       dir->pos = 0;
-      lock_init (&dir->dir_lock);
       return dir;
     }
   else
@@ -121,6 +209,9 @@ lookup (const struct dir *dir, const char *name,
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (dir_is_hashed (dir->inode))
+    return hashed_lookup (dir->inode, name, ep, ofsp);
+
   for (ofs = sizeof e; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e)
     {
@@ -146,21 +237,54 @@ dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode)
 {
   struct dir_entry e;
+  block_sector_t sector;
+  unsigned seq;
+  bool found;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (strcmp (name, "..") == 0)
+  if (strcmp (name, ".") == 0)
     {
-      inode_read_at (dir->inode, &e, sizeof e, 0);
-      *inode = inode_open (e.inode_sector);
+      *inode = inode_reopen (dir->inode);
+      return *inode != NULL;
+    }
+
+  /* Try the name cache first.  On a miss, read the directory and
+     cache what it says, including that NAME is absent.  Only what
+     is read under the directory lock is cached, and the lock is
+     held until it is, so that a result seen while dir_add() or
+     dir_remove() is moving entries around is never remembered. */
+  switch (dcache_lookup (inode_get_inumber (dir->inode), name, &sector,
+                         NULL, &seq))
+    {
+    case DCACHE_HIT:
+      *inode = inode_open (sector);
+      break;
+
+    case DCACHE_NEGATIVE:
+      *inode = NULL;
+      break;
+
+    case DCACHE_MISS:
+      inode_acquire_dir_lock (dir->inode, false);
+      if (strcmp (name, "..") == 0)
+        {
+          inode_read_at (dir->inode, &e, sizeof e, 0);
+          found = true;
+        }
+      else
+        found = lookup (dir, name, &e, NULL);
+
+      *inode = found ? inode_open (e.inode_sector) : NULL;
+      if (!found)
+        dcache_add_negative (dir->inode, name, seq);
+      else if (*inode != NULL)
+        dcache_add (dir->inode, name, e.inode_sector, inode_is_dir (*inode),
+                    seq);
+      inode_release_dir_lock (dir->inode);
+      break;
     }
-  else if (strcmp (name, ".") == 0)
-    *inode = inode_reopen (dir->inode);
-  else if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
-    *inode = NULL;
 
   return *inode != NULL;
 }
@@ -182,7 +306,7 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector, bool is
   ASSERT (name != NULL);
 
   /* Acquire dir_lock. */
-  dir_acquire_lock (dir);
+  dir_acquire_lock (dir, true);
 
   /* Check NAME for validity. */
   if (*name == '\0' || strlen (name) > NAME_MAX)
@@ -201,8 +325,9 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector, bool is
         goto done;
 
       /* Acquire curr_dir lock. */
-      dir_acquire_lock (curr_dir);
+      dir_acquire_lock (curr_dir, true);
 
+      memset (&e_, 0, sizeof e_);
       e_.in_use = false;
       e_.inode_sector = inode_get_inumber (dir_get_inode (dir));
       if (inode_write_at (curr_dir->inode, &e_, sizeof e_, 0) != sizeof e_)
@@ -216,6 +341,17 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector, bool is
         goto done;
     }
 
+  /* A hashed directory puts the entry in the leaf for its hash. */
+  if (dir_is_hashed (dir->inode))
+    {
+      memset (&e, 0, sizeof e);
+      e.in_use = true;
+      strlcpy (e.name, name, sizeof e.name);
+      e.inode_sector = inode_sector;
+      success = hashed_add (dir->inode, &e);
+      goto done;
+    }
+
   /* Set OFS to offset of free slot.
      If there are no free slots, then it will be set to the
      current end-of-file.
@@ -229,12 +365,23 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector, bool is
       break;
 
   /* Write slot. */
+  memset (&e, 0, sizeof e);
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+
+  /* Rather than grow a full linear directory past DIR_LINEAR_MAX,
+     convert it to a hashed one. */
+  if (ofs + sizeof e > DIR_LINEAR_MAX && ofs >= inode_length (dir->inode))
+    success = dir_convert (dir->inode) && hashed_add (dir->inode, &e);
+  else
+    success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
  done:
+  /* Drop a cached negative entry for NAME. */
+  if (success)
+    dcache_invalidate (inode_get_inumber (dir->inode), name);
+
   /* Release dir lock. */
   dir_release_lock (dir);
   return success;
@@ -255,7 +402,7 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (name != NULL);
 
   /* Acquire dir lock. */
-  dir_acquire_lock (dir);
+  dir_acquire_lock (dir, true);
 
   /* Find directory entry. */
   if (!lookup (dir, name, &e, &ofs))
@@ -267,22 +414,10 @@ dir_remove (struct dir *dir, const char *name)
     goto done;
   else if (inode_is_dir(inode))
   {
-    struct dir *dir_remove = dir_open(inode);
     struct dir_entry e_remove;
-    off_t ofs_remove;
+    off_t ofs_remove = 0;
 
-    bool empty = true;
-    for (ofs_remove = sizeof e_remove;
-        inode_read_at (dir_remove->inode, &e_remove, sizeof e_remove, ofs_remove) == sizeof e_remove;
-        ofs_remove += sizeof e_remove)
-      if (e_remove.in_use)
-        {
-          empty = false;
-          break;
-        }
-    dir_close(dir_remove);
-
-    if (!empty)
+    if (next_entry (inode, &ofs_remove, &e_remove))
       goto done;
   }
 
@@ -291,8 +426,12 @@ dir_remove (struct dir *dir, const char *name)
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
     goto done;
 
-  /* Remove inode. */
+  /* Remove inode.  Forget NAME and, if it was a directory,
+     anything cached about names in it. */
   inode_remove (inode);
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
+  if (inode_is_dir (inode))
+    dcache_invalidate_dir (e.inode_sector);
   success = true;
 
  done:
@@ -311,24 +450,620 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
   struct dir_entry e;
 
   /* Acquire dir lock */
-  dir_acquire_lock (dir);
+  dir_acquire_lock (dir, false);
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e)
+  if (next_entry (dir->inode, &dir->pos, &e))
     {
-      dir->pos += sizeof e;
-      if (e.in_use)
-        {
-          strlcpy (name, e.name, NAME_MAX + 1);
-          dir_release_lock (dir);
-          return true;
-        }
+      strlcpy (name, e.name, NAME_MAX + 1);
+      dir_release_lock (dir);
+      return true;
+    }
+
+  /* Release dir lock */
+  dir_release_lock (dir);
+  return false;
+}
+
+/* Reads up to CNT entries of DIR, starting where the last
+   dir_readdir() or dir_readdir_many() stopped, into RECORDS.
+   Reads the directory a block of entries at a time.  Returns the
+   number of entries read, 0 if there are no more. */
+size_t
+dir_readdir_many (struct dir *dir, struct dir_record records[], size_t cnt)
+{
+  struct dir_entry *entries = malloc (DIR_LEAF_ENTRIES * sizeof *entries);
+  block_sector_t parent = inode_get_inumber (dir->inode);
+  size_t n = 0;
+
+  if (entries == NULL)
+    return 0;
+
+  /* Acquire dir lock */
+  dir_acquire_lock (dir, false);
+
+  while (n < cnt)
+    {
+      off_t next;
+      size_t entry_cnt = read_entries (dir->inode, &dir->pos, entries, &next);
+      size_t i;
+
+      if (entry_cnt == 0)
+        break;
+      for (i = 0; i < entry_cnt && n < cnt; i++)
+        if (entries[i].in_use)
+          {
+            struct dir_record *r = &records[n++];
+            unsigned seq;
+
+            strlcpy (r->name, entries[i].name, sizeof r->name);
+            r->inumber = entries[i].inode_sector;
+
+            /* The name cache usually knows whether it is a
+               directory.  Otherwise open it to find out. */
+            if (dcache_lookup (parent, r->name, &r->inumber, &r->is_dir, &seq)
+                != DCACHE_HIT)
+              {
+                struct inode *inode = inode_open (r->inumber);
+                r->is_dir = inode != NULL && inode_is_dir (inode);
+                if (inode != NULL)
+                  dcache_add (dir->inode, r->name, r->inumber, r->is_dir, seq);
+                inode_close (inode);
+              }
+          }
+      if (i < entry_cnt)
+        dir->pos += i * sizeof *entries;
+      else
+        dir->pos = next;
     }
 
   /* Release dir lock */
   dir_release_lock (dir);
+  free (entries);
+  return n;
+}
+
+/* Reads into ENTRIES, which must have room for DIR_LEAF_ENTRIES
+   entries, the entries of the directory with the given INODE from
+   byte offset *POS to the end of the block that holds them, and
+   returns how many it read, 0 at the end of the directory.  Entry
+   I is at offset *POS + I * sizeof *ENTRIES afterward: *POS is
+   moved past blocks that hold no entries.  Sets *NEXTP to the
+   offset that follows the entries read. */
+static size_t
+read_entries (struct inode *inode, off_t *pos, struct dir_entry entries[],
+              off_t *nextp)
+{
+  size_t cnt;
+
+  if (dir_is_hashed (inode))
+    {
+      uint32_t block_cnt;
+
+      if (inode_read_at (inode, &block_cnt, sizeof block_cnt,
+                         offsetof (struct dir_root, block_cnt))
+          != sizeof block_cnt)
+        return 0;
+
+      /* Skip the root, the index blocks, and the space at the end of
+         each leaf. */
+      while (*pos / BLOCK_SECTOR_SIZE < (off_t) block_cnt)
+        {
+          off_t block_ofs = *pos - *pos % BLOCK_SECTOR_SIZE;
+          size_t slot = *pos % BLOCK_SECTOR_SIZE / sizeof *entries;
+          uint32_t magic;
+
+          if (block_ofs == 0 || slot >= DIR_LEAF_ENTRIES
+              || inode_read_at (inode, &magic, sizeof magic,
+                                block_ofs + offsetof (struct dir_leaf, magic))
+                 != sizeof magic
+              || magic != DIR_LEAF_MAGIC)
+            {
+              *pos = block_ofs + BLOCK_SECTOR_SIZE;
+              continue;
+            }
+
+          *pos = block_ofs + slot * sizeof *entries;
+          *nextp = block_ofs + BLOCK_SECTOR_SIZE;
+          cnt = DIR_LEAF_ENTRIES - slot;
+          return (inode_read_at (inode, entries, cnt * sizeof *entries, *pos)
+                  == (off_t) (cnt * sizeof *entries) ? cnt : 0);
+        }
+      return 0;
+    }
+
+  /* A linear directory has no blocks as such, so read as many
+     entries as a leaf holds. */
+  *pos -= *pos % sizeof *entries;
+  cnt = (inode_read_at (inode, entries, DIR_LEAF_ENTRIES * sizeof *entries,
+                        *pos)
+         / sizeof *entries);
+  *nextp = *pos + cnt * sizeof *entries;
+  return cnt;
+}
+
+/* Finds the first entry in use at or after byte offset *POS in the
+   directory with the given INODE, stores it into *EP, and advances
+   *POS past it.  Returns false if there is no such entry. */
+static bool
+next_entry (struct inode *inode, off_t *pos, struct dir_entry *ep)
+{
+  struct dir_entry entries[DIR_LEAF_ENTRIES];
+  size_t cnt, i;
+  off_t next;
+
+  while ((cnt = read_entries (inode, pos, entries, &next)) > 0)
+    {
+      for (i = 0; i < cnt; i++)
+        if (entries[i].in_use)
+          {
+            *ep = entries[i];
+            *pos += (i + 1) * sizeof *ep;
+            return true;
+          }
+      *pos = next;
+    }
   return false;
 }
 
+/* Returns true if the directory with the given INODE is hashed,
+   false if it is linear. */
+static bool
+dir_is_hashed (struct inode *inode)
+{
+  uint32_t magic;
+
+  return (inode_read_at (inode, &magic, sizeof magic,
+                         offsetof (struct dir_root, magic)) == sizeof magic
+          && magic == DIR_HASH_MAGIC);
+}
+
+/* Returns the hash of NAME that places it in a hashed directory. */
+static uint32_t
+dir_hash (const char *name)
+{
+  return hash_string (name);
+}
+
+/* Reads block BLOCK_NO of directory INODE into BLOCK. */
+static bool
+read_block (struct inode *inode, uint32_t block_no, void *block)
+{
+  return inode_read_at (inode, block, BLOCK_SECTOR_SIZE,
+                        block_no * BLOCK_SECTOR_SIZE) == BLOCK_SECTOR_SIZE;
+}
+
+/* Writes BLOCK to block BLOCK_NO of directory INODE, extending it
+   if necessary. */
+static bool
+write_block (struct inode *inode, uint32_t block_no, const void *block)
+{
+  return inode_write_at (inode, block, BLOCK_SECTOR_SIZE,
+                         block_no * BLOCK_SECTOR_SIZE) == BLOCK_SECTOR_SIZE;
+}
+
+/* Extends directory INODE, if necessary, to at least BLOCK_CNT
+   blocks, writing ZEROS, a zeroed block, to the last one. */
+static bool
+extend (struct inode *inode, uint32_t block_cnt, const void *zeros)
+{
+  return (inode_length (inode) >= (off_t) block_cnt * BLOCK_SECTOR_SIZE
+          || write_block (inode, block_cnt - 1, zeros));
+}
+
+/* Returns the position of the last of the CNT ENTRIES whose hash
+   is at most HASH.  ENTRIES must be sorted by hash, and the first
+   must be at most HASH. */
+static size_t
+index_search (const struct dir_index_entry entries[], size_t cnt,
+              uint32_t hash)
+{
+  size_t lo = 0, hi = cnt;
+
+  /* ENTRIES[LO].hash <= HASH < ENTRIES[HI].hash. */
+  while (hi - lo > 1)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (entries[mid].hash <= hash)
+        lo = mid;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+/* Inserts an entry mapping HASH to BLOCK_NO at position POS among
+   the *CNT ENTRIES, which must have room for it. */
+static void
+index_insert (struct dir_index_entry entries[], uint32_t *cnt, size_t pos,
+              uint32_t hash, uint32_t block_no)
+{
+  memmove (&entries[pos + 1], &entries[pos],
+           (*cnt - pos) * sizeof *entries);
+  entries[pos].hash = hash;
+  entries[pos].block = block_no;
+  (*cnt)++;
+}
+
+/* Reads into PATH the blocks of hashed directory INODE from its
+   root to the leaf that holds names with the given HASH. */
+static bool
+find_leaf (struct inode *inode, uint32_t hash, struct dir_path *path)
+{
+  struct dir_root *root = &path->root;
+
+  if (!read_block (inode, 0, root)
+      || root->cnt == 0 || root->cnt > DIR_ROOT_ENTRIES)
+    return false;
+  path->root_pos = index_search (root->entries, root->cnt, hash);
+  path->leaf_no = root->entries[path->root_pos].block;
+
+  if (root->levels == 2)
+    {
+      struct dir_index *index = &path->index;
+
+      path->index_no = path->leaf_no;
+      if (!read_block (inode, path->index_no, index)
+          || index->magic != DIR_INDEX_MAGIC
+          || index->cnt == 0 || index->cnt > DIR_INDEX_ENTRIES)
+        return false;
+      path->index_pos = index_search (index->entries, index->cnt, hash);
+      path->leaf_no = index->entries[path->index_pos].block;
+    }
+
+  return (read_block (inode, path->leaf_no, &path->leaf)
+          && path->leaf.magic == DIR_LEAF_MAGIC);
+}
+
+/* Searches hashed directory INODE for NAME, as lookup() does. */
+static bool
+hashed_lookup (struct inode *inode, const char *name,
+               struct dir_entry *ep, off_t *ofsp)
+{
+  struct dir_path *path = malloc (sizeof *path);
+  bool found = false;
+  size_t i;
+
+  if (path == NULL || !find_leaf (inode, dir_hash (name), path))
+    goto done;
+
+  for (i = 0; i < DIR_LEAF_ENTRIES; i++)
+    {
+      struct dir_entry *e = &path->leaf.entries[i];
+      if (e->in_use && !strcmp (name, e->name))
+        {
+          if (ep != NULL)
+            *ep = *e;
+          if (ofsp != NULL)
+            *ofsp = path->leaf_no * BLOCK_SECTOR_SIZE + i * sizeof *e;
+          found = true;
+          break;
+        }
+    }
+
+ done:
+  free (path);
+  return found;
+}
+
+/* Returns the first free slot in LEAF, or DIR_LEAF_ENTRIES if it
+   is full. */
+static size_t
+free_slot (const struct dir_leaf *leaf)
+{
+  size_t i;
+
+  for (i = 0; i < DIR_LEAF_ENTRIES; i++)
+    if (!leaf->entries[i].in_use)
+      break;
+  return i;
+}
+
+/* Adds a block to the index of hashed directory INODE, which maps
+   hashes from HASH on to BLOCK_NO, just after the entry in PATH
+   that leads to PATH's leaf.  Splits PATH's index block, or adds
+   a second level, to make room if necessary.  Writes the changed
+   index blocks, but not the root, and returns true if successful.
+   Returns false without changing anything if the index is full. */
+static bool
+index_add (struct inode *inode, struct dir_path *path,
+           uint32_t hash, uint32_t block_no)
+{
+  struct dir_root *root = &path->root;
+  struct dir_index *index = &path->index;
+
+  if (root->levels == 1)
+    {
+      if (root->cnt < DIR_ROOT_ENTRIES)
+        {
+          index_insert (root->entries, &root->cnt, path->root_pos + 1,
+                        hash, block_no);
+          return true;
+        }
+
+      /* Move the root's entries into an index block under it. */
+      memset (index, 0, sizeof *index);
+      index->magic = DIR_INDEX_MAGIC;
+      index->cnt = root->cnt;
+      memcpy (index->entries, root->entries,
+              root->cnt * sizeof *root->entries);
+      path->index_no = root->block_cnt++;
+      path->index_pos = path->root_pos;
+      root->levels = 2;
+      root->cnt = 1;
+      root->entries[0].hash = 0;
+      root->entries[0].block = path->index_no;
+      path->root_pos = 0;
+    }
+  else if (index->cnt == DIR_INDEX_ENTRIES)
+    {
+      /* Move the upper half of the index block into a new one. */
+      struct dir_index *upper;
+      uint32_t upper_no;
+      size_t half = DIR_INDEX_ENTRIES / 2;
+
+      if (root->cnt == DIR_ROOT_ENTRIES)
+        return false;
+      upper = calloc (1, sizeof *upper);
+      if (upper == NULL)
+        return false;
+      upper->magic = DIR_INDEX_MAGIC;
+      upper->cnt = index->cnt - half;
+      memcpy (upper->entries, &index->entries[half],
+              upper->cnt * sizeof *upper->entries);
+      index->cnt = half;
+      upper_no = root->block_cnt++;
+      index_insert (root->entries, &root->cnt, path->root_pos + 1,
+                    upper->entries[0].hash, upper_no);
+
+      if (path->index_pos >= half)
+        {
+          if (!write_block (inode, path->index_no, index))
+            {
+              free (upper);
+              return false;
+            }
+          *index = *upper;
+          path->index_no = upper_no;
+          path->index_pos -= half;
+          path->root_pos++;
+        }
+      else if (!write_block (inode, upper_no, upper))
+        {
+          free (upper);
+          return false;
+        }
+      free (upper);
+    }
+
+  index_insert (index->entries, &index->cnt, path->index_pos + 1,
+                hash, block_no);
+  return write_block (inode, path->index_no, index);
+}
+
+/* Splits PATH's leaf, which is full, in hashed directory INODE,
+   moving the entries with the upper half of its hashes into a new
+   leaf.  Leaves PATH pointing to whichever of the two leaves
+   should hold names with the given HASH.  Returns true if
+   successful, false if the leaf cannot be split because all of
+   its entries have the same hash or the index is full. */
+static bool
+split_leaf (struct inode *inode, struct dir_path *path, uint32_t hash)
+{
+  uint32_t hashes[DIR_LEAF_ENTRIES];
+  struct dir_leaf *upper;
+  uint32_t split, upper_no;
+  size_t i, j;
+
+  /* Sort the leaf's hashes, by insertion, to find the median. */
+  for (i = 0; i < DIR_LEAF_ENTRIES; i++)
+    {
+      uint32_t h = dir_hash (path->leaf.entries[i].name);
+      for (j = i; j > 0 && hashes[j - 1] > h; j--)
+        hashes[j] = hashes[j - 1];
+      hashes[j] = h;
+    }
+
+  /* Entries with equal hashes must stay together, so split at the
+     median unless it is also the lowest hash, and otherwise at the
+     next higher one. */
+  split = hashes[DIR_LEAF_ENTRIES / 2];
+  for (i = DIR_LEAF_ENTRIES / 2; split == hashes[0]; i++)
+    {
+      if (i == DIR_LEAF_ENTRIES)
+        return false;
+      split = hashes[i];
+    }
+
+  upper = calloc (1, sizeof *upper);
+  if (upper == NULL)
+    return false;
+
+  /* Extend the directory over the new leaf and a possible new index
+     block before changing anything, so that running out of disk
+     space cannot leave it half split. */
+  if (!extend (inode, path->root.block_cnt + 2, upper))
+    {
+      free (upper);
+      return false;
+    }
+
+  upper->magic = DIR_LEAF_MAGIC;
+  upper_no = path->root.block_cnt++;
+  if (!index_add (inode, path, split, upper_no))
+    {
+      free (upper);
+      return false;
+    }
+
+  for (i = j = 0; i < DIR_LEAF_ENTRIES; i++)
+    {
+      struct dir_entry *e = &path->leaf.entries[i];
+      if (dir_hash (e->name) >= split)
+        {
+          upper->entries[j++] = *e;
+          memset (e, 0, sizeof *e);
+        }
+    }
+
+  if (hash >= split)
+    {
+      if (!write_block (inode, path->leaf_no, &path->leaf))
+        {
+          free (upper);
+          return false;
+        }
+      path->leaf = *upper;
+      path->leaf_no = upper_no;
+    }
+  else if (!write_block (inode, upper_no, upper))
+    {
+      free (upper);
+      return false;
+    }
+  free (upper);
+  return true;
+}
+
+/* Adds entry E to hashed directory INODE, which must not already
+   contain its name. */
+static bool
+hashed_add (struct inode *inode, const struct dir_entry *e)
+{
+  uint32_t hash = dir_hash (e->name);
+  struct dir_path *path = malloc (sizeof *path);
+  bool success = false;
+  size_t slot;
+
+  if (path == NULL || !find_leaf (inode, hash, path))
+    goto done;
+
+  slot = free_slot (&path->leaf);
+  if (slot == DIR_LEAF_ENTRIES)
+    {
+      if (!split_leaf (inode, path, hash))
+        goto done;
+      slot = free_slot (&path->leaf);
+      ASSERT (slot < DIR_LEAF_ENTRIES);
+    }
+  path->leaf.entries[slot] = *e;
+
+  /* Write the leaf before the root, which may point to it for the
+     first time. */
+  success = (write_block (inode, path->leaf_no, &path->leaf)
+             && write_block (inode, 0, &path->root));
+
+ done:
+  free (path);
+  return success;
+}
+
+/* Converts the linear directory with the given INODE into a hashed
+   directory with the same entries.
+
+   The entries are sorted by hash and packed into half-full leaves
+   in memory.  The leaves are written past the end of the linear
+   entries, and only then is block 0 rewritten as the root that
+   points to them.  Until then the directory is still a valid linear
+   one, so a failure loses nothing.  The blocks that held linear
+   entries after block 0 are zeroed and left unused. */
+static bool
+dir_convert (struct inode *inode)
+{
+  off_t length = inode_length (inode);
+  uint32_t first = DIV_ROUND_UP (length, BLOCK_SECTOR_SIZE);
+  size_t max_entries = length / sizeof (struct dir_entry);
+  size_t fill = DIR_LEAF_ENTRIES / 2;
+  size_t max_leaves = DIV_ROUND_UP (max_entries, fill) + 1;
+  struct dir_entry *entries = malloc (max_entries * sizeof *entries);
+  uint32_t *hashes = malloc (max_entries * sizeof *hashes);
+  struct dir_root *root = calloc (1, sizeof *root);
+  struct dir_leaf *leaves = calloc (max_leaves + 1, sizeof *leaves);
+  struct dir_leaf *zeros = &leaves[max_leaves];
+  size_t cnt = 0, leaf_cnt = 0, written = 0, i, j;
+  struct dir_entry e;
+  off_t ofs;
+  bool success = false;
+
+  ASSERT (sizeof *root == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof (struct dir_index) == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof *leaves == BLOCK_SECTOR_SIZE);
+
+  if (entries == NULL || hashes == NULL || root == NULL || leaves == NULL
+      || inode_read_at (inode, &root->parent, sizeof root->parent, 0)
+         != sizeof root->parent)
+    goto done;
+
+  /* Gather the entries in use, sorted by hash, by insertion. */
+  for (ofs = sizeof e; inode_read_at (inode, &e, sizeof e, ofs) == sizeof e;
+       ofs += sizeof e)
+    if (e.in_use && cnt < max_entries)
+      {
+        uint32_t h = dir_hash (e.name);
+        for (j = cnt++; j > 0 && hashes[j - 1] > h; j--)
+          {
+            hashes[j] = hashes[j - 1];
+            entries[j] = entries[j - 1];
+          }
+        hashes[j] = h;
+        entries[j] = e;
+      }
+
+  /* Pack them into leaves of about FILL entries, keeping entries
+     with equal hashes together.  The first leaf takes all hashes
+     from 0 up. */
+  i = 0;
+  do
+    {
+      struct dir_leaf *leaf = &leaves[leaf_cnt];
+      size_t end = i + fill < cnt ? i + fill : cnt;
+
+      while (end < cnt && hashes[end] == hashes[end - 1])
+        end++;
+      if (end - i > DIR_LEAF_ENTRIES || leaf_cnt >= DIR_ROOT_ENTRIES)
+        goto done;
+      leaf->magic = DIR_LEAF_MAGIC;
+      memcpy (leaf->entries, &entries[i], (end - i) * sizeof *entries);
+      root->entries[leaf_cnt].hash = leaf_cnt == 0 ? 0 : hashes[i];
+      root->entries[leaf_cnt].block = first + leaf_cnt;
+      leaf_cnt++;
+      i = end;
+    }
+  while (i < cnt);
+
+  memset (root->parent.name, 0, sizeof root->parent.name);
+  root->magic = DIR_HASH_MAGIC;
+  root->levels = 1;
+  root->block_cnt = first + leaf_cnt;
+  root->cnt = leaf_cnt;
+
+  /* Allocate the leaves' blocks, then fill them in, then switch
+     over to them by writing the root.  The linear directory just
+     gains free slots if this fails partway. */
+  if (!extend (inode, first + leaf_cnt, zeros))
+    goto done;
+  for (; written < leaf_cnt; written++)
+    if (!write_block (inode, first + written, &leaves[written]))
+      goto done;
+  if (!write_block (inode, 0, root))
+    goto done;
+  success = true;
+
+  for (i = 1; i < first; i++)
+    write_block (inode, i, zeros);
+
+ done:
+  /* Take back the entries written to leaves that were not put in
+     use, so that the linear directory does not list them twice. */
+  if (!success)
+    for (i = 0; i < written; i++)
+      write_block (inode, first + i, zeros);
+  free (entries);
+  free (hashes);
+  free (root);
+  free (leaves);
+  return success;
+}
+
 /* Extracts a file name part from *SRCP into PART, and updates *SRCP so that the
    next call will return the next file name part. Returns 1 if successful, 0 at
    end of string, -1 for a too-long file name part. */
@@ -409,47 +1144,97 @@ dir_open_directory (const char *directory)
   /* Relative path */
   else
     curr_dir = dir_reopen (curr_thread->working_dir);
+  if (curr_dir == NULL)
+    return NULL;
 
-  /* Tokenize each directory */
+  /* Tokenize each directory.  Components found in the name cache
+     are followed by sector alone, so CURR_DIR is only opened, at
+     CURR_SECTOR, when a component has to be read from it. */
+  block_sector_t curr_sector = inode_get_inumber (curr_dir->inode);
   char dir_token[NAME_MAX + 1];
   while (get_next_part (dir_token, &directory) == 1)
     {
-      /* Lookup directory from current directory */
-      struct inode *next_inode;
-      if (!dir_lookup (curr_dir, dir_token, &next_inode))
+      block_sector_t next_sector;
+      bool is_dir;
+      unsigned seq;
+
+      if (strcmp (dir_token, ".") == 0)
+        continue;
+
+      switch (dcache_lookup (curr_sector, dir_token, &next_sector, &is_dir,
+                             &seq))
         {
+        case DCACHE_HIT:
+          if (!is_dir)
+            goto fail;
           dir_close (curr_dir);
-          return NULL;
-        }
-
-      /* Open directory from inode received above */
-      struct dir *next_dir = dir_open (next_inode);
+          curr_dir = NULL;
+          curr_sector = next_sector;
+          break;
 
-      /* Close current directory and assign next directory as current */
-      dir_close (curr_dir);
-      if (!next_dir)
+        case DCACHE_NEGATIVE:
+          goto fail;
+
+        case DCACHE_MISS:
+          {
+            /* Lookup directory from current directory */
+            struct inode *next_inode;
+            if (curr_dir == NULL)
+              {
+                curr_dir = dir_open (inode_open (curr_sector));
+                if (curr_dir == NULL)
+                  return NULL;
+              }
+            if (!dir_lookup (curr_dir, dir_token, &next_inode))
+              goto fail;
+            if (!inode_is_dir (next_inode))
+              {
+                inode_close (next_inode);
+                goto fail;
+              }
+
+            /* Open directory from inode received above.  Close
+               current directory and assign next directory as
+               current */
+            dir_close (curr_dir);
+            curr_dir = dir_open (next_inode);
+            if (curr_dir == NULL)
+              return NULL;
+            curr_sector = inode_get_inumber (curr_dir->inode);
+          }
+          break;
+        }
+    }
+  if (curr_dir == NULL)
+    {
+      curr_dir = dir_open (inode_open (curr_sector));
+      if (curr_dir == NULL)
         return NULL;
-      curr_dir = next_dir;
     }
 
   /* Return the last found inode if it is not removed */
   if (!inode_is_removed (dir_get_inode (curr_dir)))
     return curr_dir;
 
+ fail:
   dir_close (curr_dir);
   return NULL;
 }
 
-/* Acquire the lock of DIR. */
+/* Acquire the lock of DIR, exclusively if EXCLUSIVE is true, to
+   change DIR's entries, and otherwise shared, to read them.  The
+   lock belongs to DIR's inode, so that it covers every handle on
+   one directory.  Adding an entry to a hashed directory may move
+   others between blocks, so even lookups must hold the lock. */
 void
-dir_acquire_lock (struct dir *dir)
+dir_acquire_lock (struct dir *dir, bool exclusive)
 {
-  lock_acquire (&(dir->dir_lock));
+  inode_acquire_dir_lock (dir->inode, exclusive);
 }
 
 /* Release the lock of DIR. */
 void
 dir_release_lock (struct dir *dir)
 {
-  lock_release (&(dir->dir_lock));
+  inode_release_dir_lock (dir->inode);
 }
@@ -27,11 +27,22 @@ bool dir_add (struct dir *, const char *name, block_sector_t, bool is_dir);
 bool dir_remove (struct dir *, const char *name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
 
+/* A directory entry read by dir_readdir_many().  Its layout must
+   match struct readdir_entry in lib/user/syscall.h. */
+struct dir_record
+  {
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+    block_sector_t inumber;             /* Inode sector. */
+    bool is_dir;                        /* Directory? */
+  };
+
+size_t dir_readdir_many (struct dir *, struct dir_record[], size_t cnt);
+
 bool split_directory_and_filename (const char *path, char *directory, char *filename);
 struct dir *dir_open_directory (const char *directory);
 
 /* Directory locks */
-void dir_acquire_lock (struct dir *dir);
+void dir_acquire_lock (struct dir *dir, bool exclusive);
 void dir_release_lock (struct dir *dir);
 
 #endif /* filesys/directory.h */
@@ -4,14 +4,28 @@
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
+/* Read-ahead window limits, in sectors.  The window starts at
+   READAHEAD_MIN on the first sequential read and doubles with each
+   one after that, up to READAHEAD_MAX. */
+#define READAHEAD_MIN 4
+#define READAHEAD_MAX 32
+
 /* An open file. */
 struct file
   {
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    bool direct;                /* Read whole sectors around the cache? */
+
+    /* Sequential read detection, see file_readahead(). */
+    off_t ra_next;              /* Where the next sequential read starts. */
+    off_t ra_end;               /* End of the bytes already read ahead. */
+    int ra_window;              /* Sectors to read ahead, 0 if random. */
   };
 
+static void file_readahead (struct file *, off_t start, off_t size);
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
@@ -24,6 +38,10 @@ file_open (struct inode *inode)
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->direct = false;
+      file->ra_next = 0;
+      file->ra_end = 0;
+      file->ra_window = 0;
       return file;
     }
   else
@@ -69,13 +87,53 @@ file_get_inode (struct file *file)
 off_t
 file_read (struct file *file, void *buffer, off_t size)
 {
-  inode_acquire_lock (file->inode);
-  off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
-  inode_release_lock (file->inode);
+  off_t bytes_read;
+
+  if (file->direct)
+    bytes_read = inode_read_at_direct (file->inode, buffer, size, file->pos);
+  else
+    {
+      bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+      file_readahead (file, file->pos, bytes_read);
+    }
   file->pos += bytes_read;
   return bytes_read;
 }
 
+/* Updates FILE's read-ahead state after a read of SIZE bytes at
+   START.  A read that begins where the previous one ended grows the
+   read-ahead window, and the sectors within the window past the
+   end of the read are queued to be read in the background.  Any
+   other read collapses the window. */
+static void
+file_readahead (struct file *file, off_t start, off_t size)
+{
+  off_t end = start + size;
+  off_t ra_start, ra_end;
+
+  if (start == file->ra_next)
+    file->ra_window = (file->ra_window == 0 ? READAHEAD_MIN
+                       : file->ra_window * 2 < READAHEAD_MAX
+                       ? file->ra_window * 2 : READAHEAD_MAX);
+  else
+    {
+      file->ra_window = 0;
+      file->ra_end = 0;
+    }
+  file->ra_next = end;
+  if (file->ra_window == 0 || size == 0)
+    return;
+
+  /* Skip whatever earlier reads already asked for. */
+  ra_start = end > file->ra_end ? end : file->ra_end;
+  ra_end = end + file->ra_window * BLOCK_SECTOR_SIZE;
+  if (ra_start < ra_end)
+    {
+      inode_readahead (file->inode, ra_end - ra_start, ra_start);
+      file->ra_end = ra_end;
+    }
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually read,
@@ -97,9 +155,7 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
 off_t
 file_write (struct file *file, const void *buffer, off_t size)
 {
-  inode_acquire_lock (file->inode);
   off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
-  inode_release_lock (file->inode);
   file->pos += bytes_written;
   return bytes_written;
 }
@@ -118,6 +174,17 @@ file_write_at (struct file *file, const void *buffer, off_t size,
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Sets whether reads from FILE bypass the buffer cache.  With
+   direct I/O, whole sectors that are not cached are read from disk
+   straight into the caller's buffer and are not cached, which suits
+   files that are streamed once.  Read-ahead is not done. */
+void
+file_set_direct (struct file *file, bool direct)
+{
+  ASSERT (file != NULL);
+  file->direct = direct;
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
@@ -1,6 +1,7 @@
 #ifndef FILESYS_FILE_H
 #define FILESYS_FILE_H
 
+#include <stdbool.h>
 #include "filesys/off_t.h"
 
 struct inode;
@@ -21,6 +22,9 @@ off_t file_write_at (struct file *, const void *, off_t size, off_t start);
 void file_deny_write (struct file *);
 void file_allow_write (struct file *);
 
+/* Direct I/O. */
+void file_set_direct (struct file *, bool);
+
 /* File position. */
 void file_seek (struct file *, off_t);
 off_t file_tell (struct file *);
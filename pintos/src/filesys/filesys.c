@@ -7,6 +7,7 @@
 #include "filesys/inode.h"
 #include "filesys/directory.h"
 #include "filesys/cache.h"
+#include "filesys/dcache.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
@@ -23,6 +24,7 @@ filesys_init (bool format)
     PANIC ("No file system device found, can't initialize file system.");
 
   inode_init ();
+  dcache_init ();
   cache_init ();
   free_map_init ();
 
@@ -30,6 +32,8 @@ filesys_init (bool format)
     do_format ();
 
   free_map_open ();
+  cache_start_flusher (fs_device);
+  cache_start_readahead (fs_device);
 }
 
 /* Shuts down the file system module, writing any unwritten data
@@ -57,9 +61,13 @@ filesys_create (const char *name, off_t initial_size, bool is_dir)
 
   bool split_success = split_directory_and_filename (name, directory, filename);
   struct dir *dir = dir_open_directory (directory);
+  block_sector_t parent_sector = (dir != NULL
+                                  ? inode_get_inumber (dir_get_inode (dir))
+                                  : ROOT_DIR_SECTOR);
 
   bool success = (split_success && dir != NULL
-                  && free_map_allocate (1, &inode_sector)
+                  && free_map_allocate_inode (parent_sector, is_dir,
+                                              &inode_sector)
                   && inode_create (inode_sector, initial_size, is_dir)
                   && dir_add (dir, filename, inode_sector, is_dir));
   if (!success && inode_sector != 0)
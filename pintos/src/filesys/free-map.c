@@ -1,19 +1,50 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/synch.h"
+
+/* Number of free map bits stored in one sector of the free map
+   file. */
+#define FREE_MAP_BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * 8)
+
+/* Number of sectors in an allocation group.  Like the cylinder
+   groups of the BSD fast file system, groups keep a file's inode
+   near its directory and its data near its inode. */
+#define FREE_MAP_GROUP_SECTORS 1024
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
 
+/* Sectors of the free map file that have changed in memory since
+   they were last written, one bit per sector.  Allocating or
+   releasing sectors only marks these; free_map_sync () writes
+   them out. */
+static struct bitmap *free_map_dirty;
+
+/* Protects free_map and free_map_dirty. */
+static struct lock free_map_lock;
+
+static void mark_dirty (block_sector_t sector, size_t cnt);
+static bool write_dirty (void);
+static size_t find_run (size_t start, size_t end, size_t cnt);
+static size_t take_run (size_t start, size_t cnt);
+static size_t emptiest_group (void);
+
 /* Initializes the free map. */
 void
 free_map_init (void)
 {
+  lock_init (&free_map_lock);
   free_map = bitmap_create (block_size (fs_device));
-  if (free_map == NULL)
+  if (free_map == NULL || !bitmap_enable_summary (free_map))
+    PANIC ("bitmap creation failed--file system device is too large");
+  free_map_dirty = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+                                                BLOCK_SECTOR_SIZE));
+  if (free_map_dirty == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
@@ -22,31 +53,148 @@ free_map_init (void)
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available.  The change reaches the free map file
+   at the next free_map_sync (). */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
-    {
-      bitmap_set_multiple (free_map, sector, cnt, false);
-      sector = BITMAP_ERROR;
-    }
+  block_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  if (sector != BITMAP_ERROR)
+    mark_dirty (sector, cnt);
+  lock_release (&free_map_lock);
+
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Allocates a run of between 1 and CNT consecutive sectors,
+   preferring sectors at or just after GOAL, and stores the first
+   into *SECTORP.  Returns the number of sectors allocated, which
+   is 0 only if the disk is full.
+
+   The run starts at GOAL if GOAL is free, so that a file that
+   grows stays contiguous even if the run is short.  Otherwise it
+   is the first run of CNT free sectors after GOAL in GOAL's
+   allocation group, then on the rest of the disk, and failing
+   that as much of a run as there is at the first free sector. */
+size_t
+free_map_allocate_run (block_sector_t goal, size_t cnt,
+                       block_sector_t *sectorp)
+{
+  size_t bit_cnt = bitmap_size (free_map);
+  size_t group_end;
+  size_t sector;
+
+  ASSERT (cnt > 0);
+  if (goal >= bit_cnt)
+    goal = 0;
+  group_end = (goal / FREE_MAP_GROUP_SECTORS + 1) * FREE_MAP_GROUP_SECTORS;
+  if (group_end > bit_cnt)
+    group_end = bit_cnt;
+
+  lock_acquire (&free_map_lock);
+  if (!bitmap_test (free_map, goal))
+    sector = goal;
+  else if ((sector = find_run (goal, group_end, cnt)) == BITMAP_ERROR
+           && (sector = find_run (group_end, bit_cnt, cnt)) == BITMAP_ERROR
+           && (sector = find_run (0, goal, cnt)) == BITMAP_ERROR
+           && (sector = bitmap_scan (free_map, goal, 1, false)) == BITMAP_ERROR)
+    sector = bitmap_scan (free_map, 0, 1, false);
+  if (sector != BITMAP_ERROR)
+    cnt = take_run (sector, cnt);
+  else
+    cnt = 0;
+  lock_release (&free_map_lock);
+
+  if (cnt > 0)
+    *sectorp = sector;
+  return cnt;
+}
+
+/* Allocates a sector for a new inode in the directory whose inode
+   is at sector PARENT, and stores it into *SECTORP.  A file's
+   inode goes at the first free sector after its directory's, so
+   that the files of a directory stay together.  A directory's
+   inode goes in the allocation group with the most free sectors,
+   to leave room for the files that will be created in it.
+   Returns true if successful, false if the disk is full. */
+bool
+free_map_allocate_inode (block_sector_t parent, bool is_dir,
+                         block_sector_t *sectorp)
+{
+  block_sector_t goal = parent;
+
+  if (is_dir)
+    {
+      lock_acquire (&free_map_lock);
+      goal = emptiest_group () * FREE_MAP_GROUP_SECTORS;
+      lock_release (&free_map_lock);
+    }
+  return free_map_allocate_run (goal, 1, sectorp) == 1;
+}
+
+/* Makes CNT sectors starting at SECTOR available for use.  The
+   change reaches the free map file at the next
+   free_map_sync (). */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  mark_dirty (sector, cnt);
+  lock_release (&free_map_lock);
+}
+
+/* Writes the sectors of the free map file that changed since they
+   were last written.  Does nothing while the free map file is not
+   open.  Returns true if successful, false if a write failed, in
+   which case the sectors not written stay marked for the next
+   sync. */
+bool
+free_map_sync (void)
+{
+  bool success;
+
+  lock_acquire (&free_map_lock);
+  success = write_dirty ();
+  lock_release (&free_map_lock);
+
+  return success;
+}
+
+/* Stores statistics on the free space into *STATS. */
+void
+free_map_get_stats (struct free_map_stats *stats)
+{
+  size_t bit_cnt = bitmap_size (free_map);
+  size_t start = 0;
+
+  stats->free_cnt = 0;
+  stats->extent_cnt = 0;
+  stats->largest = 0;
+
+  lock_acquire (&free_map_lock);
+  while (start < bit_cnt
+         && (start = bitmap_scan (free_map, start, 1, false)) != BITMAP_ERROR)
+    {
+      size_t end = bitmap_scan (free_map, start, 1, true);
+      size_t len;
+
+      if (end == BITMAP_ERROR)
+        end = bit_cnt;
+      len = end - start;
+      stats->free_cnt += len;
+      stats->extent_cnt++;
+      if (len > stats->largest)
+        stats->largest = len;
+      start = end;
+    }
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -58,13 +206,19 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  bitmap_set_all (free_map_dirty, false);
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void)
 {
+  lock_acquire (&free_map_lock);
+  if (!write_dirty ())
+    PANIC ("can't write free map");
   file_close (free_map_file);
+  free_map_file = NULL;
+  lock_release (&free_map_lock);
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -82,4 +236,111 @@ free_map_create (void)
     PANIC ("can't open free map");
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
+  bitmap_set_all (free_map_dirty, false);
+}
+
+/* Marks the free map file sectors that hold the bits for the CNT
+   sectors starting at SECTOR as changed.  free_map_lock must be
+   held. */
+static void
+mark_dirty (block_sector_t sector, size_t cnt)
+{
+  size_t first = sector / FREE_MAP_BITS_PER_SECTOR;
+  size_t last = (sector + cnt - 1) / FREE_MAP_BITS_PER_SECTOR;
+
+  ASSERT (lock_held_by_current_thread (&free_map_lock));
+  ASSERT (cnt > 0);
+
+  bitmap_set_multiple (free_map_dirty, first, last - first + 1, true);
+}
+
+/* Returns the first sector of the first run of CNT free sectors
+   that lies within sectors START...END, or BITMAP_ERROR if there
+   is none.  free_map_lock must be held. */
+static size_t
+find_run (size_t start, size_t end, size_t cnt)
+{
+  size_t sector;
+
+  if (start >= end)
+    return BITMAP_ERROR;
+  sector = bitmap_scan (free_map, start, cnt, false);
+  return sector != BITMAP_ERROR && sector + cnt <= end ? sector : BITMAP_ERROR;
+}
+
+/* Marks the free sector START and the free sectors after it, up to
+   CNT sectors in all, as in use.  Returns the number marked.
+   free_map_lock must be held. */
+static size_t
+take_run (size_t start, size_t cnt)
+{
+  size_t bit_cnt = bitmap_size (free_map);
+  size_t len = 1;
+
+  ASSERT (!bitmap_test (free_map, start));
+  while (len < cnt && start + len < bit_cnt
+         && !bitmap_test (free_map, start + len))
+    len++;
+  bitmap_set_multiple (free_map, start, len, true);
+  mark_dirty (start, len);
+  return len;
+}
+
+/* Returns the allocation group with the most free sectors, the
+   lowest-numbered one if there is a tie.  free_map_lock must be
+   held. */
+static size_t
+emptiest_group (void)
+{
+  size_t bit_cnt = bitmap_size (free_map);
+  size_t best = 0, best_free = 0;
+  size_t group;
+
+  for (group = 0; group * FREE_MAP_GROUP_SECTORS < bit_cnt; group++)
+    {
+      size_t start = group * FREE_MAP_GROUP_SECTORS;
+      size_t cnt = bit_cnt - start < FREE_MAP_GROUP_SECTORS
+                   ? bit_cnt - start : FREE_MAP_GROUP_SECTORS;
+      size_t free_cnt = bitmap_count (free_map, start, cnt, false);
+      if (free_cnt > best_free)
+        {
+          best = group;
+          best_free = free_cnt;
+        }
+    }
+  return best;
+}
+
+/* Writes each run of consecutive changed sectors of the free map
+   file with one write, for free_map_sync ().  free_map_lock must be
+   held. */
+static bool
+write_dirty (void)
+{
+  size_t sector_cnt = bitmap_size (free_map_dirty);
+  size_t start = 0;
+  bool success = true;
+
+  ASSERT (lock_held_by_current_thread (&free_map_lock));
+
+  if (free_map_file == NULL)
+    return true;
+  while (start < sector_cnt
+         && (start = bitmap_scan (free_map_dirty, start, 1, true))
+            != BITMAP_ERROR)
+    {
+      size_t cnt = 1;
+
+      while (start + cnt < sector_cnt
+             && bitmap_test (free_map_dirty, start + cnt))
+        cnt++;
+      if (bitmap_write_range (free_map, free_map_file,
+                              start * BLOCK_SECTOR_SIZE,
+                              cnt * BLOCK_SECTOR_SIZE))
+        bitmap_set_multiple (free_map_dirty, start, cnt, false);
+      else
+        success = false;
+      start += cnt;
+    }
+  return success;
 }
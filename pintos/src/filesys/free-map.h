@@ -10,8 +10,23 @@ void free_map_read (void);
 void free_map_create (void);
 void free_map_open (void);
 void free_map_close (void);
+bool free_map_sync (void);
 
 bool free_map_allocate (size_t, block_sector_t *);
+size_t free_map_allocate_run (block_sector_t goal, size_t cnt,
+                              block_sector_t *);
+bool free_map_allocate_inode (block_sector_t parent, bool is_dir,
+                              block_sector_t *);
 void free_map_release (block_sector_t, size_t);
 
+/* Free space statistics. */
+struct free_map_stats
+  {
+    size_t free_cnt;            /* Free sectors. */
+    size_t extent_cnt;          /* Runs of consecutive free sectors. */
+    size_t largest;             /* Sectors in the longest run. */
+  };
+
+void free_map_get_stats (struct free_map_stats *);
+
 #endif /* filesys/free-map.h */
@@ -1,5 +1,6 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,10 +8,16 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
 
+/* Number of sectors fsutil_extract() reads from the scratch device
+   in one request. */
+#define EXTRACT_CHUNK_SECTORS 8
+
 /* List files in the root directory. */
 void
 fsutil_ls (char **argv UNUSED)
@@ -27,6 +34,39 @@ fsutil_ls (char **argv UNUSED)
   printf ("End of listing.\n");
 }
 
+/* Reports how fragmented the free space and the files in the root
+   directory are. */
+void
+fsutil_frag (char **argv UNUSED)
+{
+  struct free_map_stats stats;
+  struct dir *dir;
+  char name[NAME_MAX + 1];
+
+  free_map_get_stats (&stats);
+  printf ("Free space: %zu sectors in %zu extents, largest %zu sectors.\n",
+          stats.free_cnt, stats.extent_cnt, stats.largest);
+
+  printf ("Files in the root directory:\n");
+  dir = dir_open_root ();
+  if (dir == NULL)
+    PANIC ("root dir open failed");
+  while (dir_readdir (dir, name))
+    {
+      struct inode *inode;
+      size_t sector_cnt, extent_cnt;
+
+      if (!dir_lookup (dir, name, &inode))
+        continue;
+      sector_cnt = inode_extents (inode, &extent_cnt);
+      printf ("%s: %zu sectors in %zu extents\n",
+              name, sector_cnt, extent_cnt);
+      inode_close (inode);
+    }
+  dir_close (dir);
+  printf ("End of report.\n");
+}
+
 /* Prints the contents of file ARGV[1] to the system console as
    hex and ASCII. */
 void
@@ -78,7 +118,7 @@ fsutil_extract (char **argv UNUSED)
 
   /* Allocate buffers. */
   header = malloc (BLOCK_SECTOR_SIZE);
-  data = malloc (BLOCK_SECTOR_SIZE);
+  data = malloc (EXTRACT_CHUNK_SECTORS * BLOCK_SECTOR_SIZE);
   if (header == NULL || data == NULL)
     PANIC ("couldn't allocate buffers");
 
@@ -123,13 +163,15 @@ fsutil_extract (char **argv UNUSED)
           if (dst == NULL)
             PANIC ("%s: open failed", file_name);
 
-          /* Do copy. */
+          /* Do copy, several sectors per request. */
           while (size > 0)
             {
-              int chunk_size = (size > BLOCK_SECTOR_SIZE
-                                ? BLOCK_SECTOR_SIZE
+              int chunk_size = (size > EXTRACT_CHUNK_SECTORS * BLOCK_SECTOR_SIZE
+                                ? EXTRACT_CHUNK_SECTORS * BLOCK_SECTOR_SIZE
                                 : size);
-              block_read (src, sector++, data);
+              size_t chunk_sectors = DIV_ROUND_UP (chunk_size, BLOCK_SECTOR_SIZE);
+              block_read_multiple (src, sector, chunk_sectors, data);
+              sector += chunk_sectors;
               if (file_write (dst, data, chunk_size) != chunk_size)
                 PANIC ("%s: write failed with %d bytes unwritten",
                        file_name, size);
@@ -1,4 +1,5 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
@@ -17,6 +18,12 @@
 #define DIRECT_BLOCK_COUNT 123
 #define INDIRECT_BLOCK_COUNT 128
 
+/* Number of sectors beyond those it needs that a file takes from
+   the free map when it grows, so that the writes that extend it
+   further find sectors right after its last ones even while other
+   files are growing too. */
+#define PREALLOC_SECTORS 16
+
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
 struct inode_disk
@@ -44,6 +51,27 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
+/* In-memory copy of an indirect block, kept by an open inode so
+   that consecutive sectors can be mapped without copying the block
+   out of the cache each time. */
+struct indirect_map
+  {
+    block_sector_t sector;              /* Indirect block held, or -1. */
+    struct indirect_block_sector *block; /* Its contents, malloc'd lazily. */
+  };
+
+/* Where inode_allocate () gets new sectors: a run of sectors
+   already taken from the free map, and how many more sectors to
+   ask for when the run is used up.  NEXT doubles as the sector to
+   look near then, so that a file's sectors, including its
+   indirect blocks, follow each other on disk. */
+struct alloc_cursor
+  {
+    block_sector_t next;                /* Next sector of the run. */
+    size_t left;                        /* Sectors left in the run. */
+    size_t want;                        /* Sectors still to allocate. */
+  };
+
 /* Min function */
 static inline size_t
 min (size_t x, size_t y)
@@ -54,36 +82,68 @@ min (size_t x, size_t y)
 /* In-memory inode. */
 struct inode
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
-    struct lock inode_lock;             /* Inode lock. */
+    struct rw_lock rw_lock;             /* Shared for reads and writes
+                                           within the file, exclusive
+                                           for writes that extend it. */
+    struct rw_lock dir_lock;            /* Shared for lookups in a
+                                           directory, exclusive for
+                                           changes to its entries. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct inode_disk data;             /* Inode content, written through. */
+
+    /* Translation cache for byte_to_sector (). */
+    struct lock map_lock;               /* Protects the maps below. */
+    struct indirect_map map_root;       /* Last doubly indirect block. */
+    struct indirect_map map_leaf;       /* Last indirect block. */
+
+    /* Preallocation window: sectors taken from the free map for the
+       inode to grow into, released when the inode is closed. */
+    block_sector_t prealloc_next;       /* First sector of the window. */
+    size_t prealloc_cnt;                /* Sectors in the window. */
   };
 
 /* Functions replaced free_map_allocate () */
-static bool inode_allocate (struct inode_disk *disk_inode, off_t length);
-static bool inode_allocate_sector (block_sector_t *sector_num);
-static bool inode_allocate_indirect (block_sector_t *sector_num, size_t cnt);
-static bool inode_allocate_doubly_indirect (block_sector_t *sector_num, size_t cnt);
+static bool inode_allocate (struct inode_disk *disk_inode, off_t length,
+                            struct alloc_cursor *cursor);
+static bool inode_allocate_sector (block_sector_t *sector_num,
+                                   struct alloc_cursor *cursor);
+static bool inode_allocate_indirect (block_sector_t *sector_num, size_t cnt,
+                                     struct alloc_cursor *cursor);
+static bool inode_allocate_doubly_indirect (block_sector_t *sector_num,
+                                            size_t cnt,
+                                            struct alloc_cursor *cursor);
+static size_t inode_sector_count (off_t length);
 
 /* Functions replaced free_map_release () */
 static void inode_deallocate (struct inode *inode);
 static void inode_deallocate_indirect (block_sector_t sector_num, size_t cnt);
 static void inode_deallocate_doubly_indirect (block_sector_t sector_num, size_t cnt);
 
+static void inode_write_disk (struct inode *inode);
+
+static block_sector_t indirect_map_lookup (struct indirect_map *map,
+                                           block_sector_t sector,
+                                           size_t index);
+static void indirect_map_init (struct indirect_map *map);
+static void inode_map_invalidate (struct inode *inode);
+static off_t inode_read (struct inode *inode, void *buffer_, off_t size,
+                         off_t offset, bool direct);
+
 
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
    POS. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos)
+byte_to_sector (struct inode *inode, off_t pos)
 {
   ASSERT (inode != NULL);
   block_sector_t sector = -1;
-  struct inode_disk *disk_inode = get_inode_disk (inode);
+  const struct inode_disk *disk_inode = &inode->data;
 
   if (pos < disk_inode->length)
     {
@@ -98,45 +158,129 @@ byte_to_sector (const struct inode *inode, off_t pos)
           /* remove direct block bias */
           index -= DIRECT_BLOCK_COUNT;
 
-          struct indirect_block_sector indirect_block;
-          cache_read (fs_device, disk_inode->indirect_block,
-                      &indirect_block, 0, BLOCK_SECTOR_SIZE);
-          sector = indirect_block.block[index];
+          lock_acquire (&inode->map_lock);
+          sector = indirect_map_lookup (&inode->map_leaf,
+                                        disk_inode->indirect_block, index);
+          lock_release (&inode->map_lock);
         }
       /* doubly indirect block */
       else
         {
           /* remove direct and indirect block bias */
           index -= (DIRECT_BLOCK_COUNT + INDIRECT_BLOCK_COUNT);
-          struct indirect_block_sector indirect_block;
 
           /* get doubly indirect and indirect block index */
           int did_index = index / INDIRECT_BLOCK_COUNT;
           int id_index  = index % INDIRECT_BLOCK_COUNT;
 
-          /* Read doubly indirect block, then indirect block */
-          cache_read (fs_device, disk_inode->doubly_indirect_block,
-                      &indirect_block, 0, BLOCK_SECTOR_SIZE);
-          cache_read (fs_device, indirect_block.block[did_index],
-                      &indirect_block, 0, BLOCK_SECTOR_SIZE);
-
-          sector = indirect_block.block[id_index];
+          /* Look up doubly indirect block, then indirect block */
+          lock_acquire (&inode->map_lock);
+          sector = indirect_map_lookup (&inode->map_root,
+                                        disk_inode->doubly_indirect_block,
+                                        did_index);
+          sector = indirect_map_lookup (&inode->map_leaf, sector, id_index);
+          lock_release (&inode->map_lock);
         }
     }
 
-  free(disk_inode);
   return sector;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Returns entry INDEX of indirect block SECTOR, using MAP's copy of
+   the block if it holds SECTOR and refilling MAP from the cache
+   otherwise.  If MAP cannot be allocated, reads only the one entry. */
+static block_sector_t
+indirect_map_lookup (struct indirect_map *map, block_sector_t sector,
+                     size_t index)
+{
+  ASSERT (index < INDIRECT_BLOCK_COUNT);
+
+  if (map->block == NULL)
+    map->block = malloc (sizeof *map->block);
+  if (map->block == NULL)
+    {
+      block_sector_t entry;
+      cache_read (fs_device, sector, &entry, index * sizeof entry,
+                  sizeof entry);
+      return entry;
+    }
+
+  if (map->sector != sector)
+    {
+      cache_read (fs_device, sector, map->block, 0, BLOCK_SECTOR_SIZE);
+      map->sector = sector;
+    }
+  return map->block->block[index];
+}
+
+/* Initializes MAP to hold no indirect block. */
+static void
+indirect_map_init (struct indirect_map *map)
+{
+  map->sector = -1;
+  map->block = NULL;
+}
+
+/* Forgets INODE's copies of its indirect blocks, which must be done
+   whenever the blocks change on disk. */
+static void
+inode_map_invalidate (struct inode *inode)
+{
+  lock_acquire (&inode->map_lock);
+  inode->map_root.sector = -1;
+  inode->map_leaf.sector = -1;
+  lock_release (&inode->map_lock);
+}
+
+/* Open inodes, keyed by sector, so that opening a single inode
+   twice returns the same `struct inode'. */
+static struct hash open_inodes;
+
+/* Protects open_inodes, the open_cnt of each inode in it, and the
+   statistics below. */
+static struct lock open_inodes_lock;
+
+/* Statistics. */
+static size_t open_inode_cnt;           /* Inodes now open. */
+static size_t max_open_inode_cnt;       /* Most inodes open at once. */
+static long long open_lookup_cnt;       /* Calls to inode_open(). */
+static long long open_hit_cnt;          /* ...that found it open. */
+
+static hash_hash_func open_inode_hash;
+static hash_less_func open_inode_less;
 
 /* Initializes the inode module. */
 void
 inode_init (void)
 {
-  list_init (&open_inodes);
+  lock_init (&open_inodes_lock);
+  if (!hash_init (&open_inodes, open_inode_hash, open_inode_less, NULL))
+    PANIC ("open inode table initialization failed");
+}
+
+/* Prints statistics on open inodes. */
+void
+inode_print_stats (void)
+{
+  printf ("Inodes: %zu open, at most %zu, %lld opens, %lld already open\n",
+          open_inode_cnt, max_open_inode_cnt, open_lookup_cnt,
+          open_hit_cnt);
+}
+
+/* Returns a hash value for the sector of open inode E. */
+static unsigned
+open_inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+/* Returns true if open inode A's sector precedes B's. */
+static bool
+open_inode_less (const struct hash_elem *a, const struct hash_elem *b,
+                 void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode, elem)->sector
+          < hash_entry (b, struct inode, elem)->sector);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -160,14 +304,22 @@ inode_create (block_sector_t sector, off_t length, bool is_dir)
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
+      /* Put the data right after the inode. */
+      struct alloc_cursor cursor;
+      cursor.next = sector + 1;
+      cursor.left = 0;
+      cursor.want = inode_sector_count (length);
+
       disk_inode->is_dir = is_dir;
       disk_inode->length = length;
       disk_inode->magic  = INODE_MAGIC;
-      if (inode_allocate (disk_inode, length))
+      if (inode_allocate (disk_inode, length, &cursor))
         {
           cache_write (fs_device, sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
           success = true;
         }
+      if (cursor.left > 0)
+        free_map_release (cursor.next, cursor.left);
       free (disk_inode);
     }
   return success;
@@ -179,33 +331,50 @@ inode_create (block_sector_t sector, off_t length, bool is_dir)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct hash_elem *e;
   struct inode *inode;
-
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e))
+  struct inode key;
+
+  /* Check whether this inode is already open.  The lock is held
+     until a new inode is read in, so that no other thread opens
+     it a second time meanwhile. */
+  lock_acquire (&open_inodes_lock);
+  open_lookup_cnt++;
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector)
-        {
-          inode_reopen (inode);
-          return inode;
-        }
+      inode = hash_entry (e, struct inode, elem);
+      inode->open_cnt++;
+      open_hit_cnt++;
+      lock_release (&open_inodes_lock);
+      return inode;
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  lock_init (&inode->inode_lock);
+  rw_lock_init (&inode->rw_lock);
+  rw_lock_init (&inode->dir_lock);
+  lock_init (&inode->map_lock);
+  indirect_map_init (&inode->map_root);
+  indirect_map_init (&inode->map_leaf);
+  inode->prealloc_cnt = 0;
+  cache_read (fs_device, inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  hash_insert (&open_inodes, &inode->elem);
+  if (++open_inode_cnt > max_open_inode_cnt)
+    max_open_inode_cnt = open_inode_cnt;
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -214,7 +383,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -236,20 +409,32 @@ inode_close (struct inode *inode)
     return;
 
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  lock_acquire (&open_inodes_lock);
+  if (--inode->open_cnt > 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
+      lock_release (&open_inodes_lock);
+      return;
+    }
 
-      /* Deallocate blocks if removed. */
-      if (inode->removed)
-        {
-          free_map_release (inode->sector, 1);
-          inode_deallocate (inode);
-        }
+  /* Remove from the open inodes and release lock. */
+  hash_delete (&open_inodes, &inode->elem);
+  open_inode_cnt--;
+  lock_release (&open_inodes_lock);
 
-      free (inode);
+  /* Give back the preallocation window. */
+  if (inode->prealloc_cnt > 0)
+    free_map_release (inode->prealloc_next, inode->prealloc_cnt);
+
+  /* Deallocate blocks if removed. */
+  if (inode->removed)
+    {
+      free_map_release (inode->sector, 1);
+      inode_deallocate (inode);
     }
+
+  free (inode->map_root.block);
+  free (inode->map_leaf.block);
+  free (inode);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -266,10 +451,33 @@ inode_remove (struct inode *inode)
    than SIZE if an error occurs or end of file is reached. */
 off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
+{
+  return inode_read (inode, buffer_, size, offset, false);
+}
+
+/* Like inode_read_at (), but whole sectors that are not in the cache
+   are read from disk directly into BUFFER and are not cached. */
+off_t
+inode_read_at_direct (struct inode *inode, void *buffer_, off_t size,
+                      off_t offset)
+{
+  return inode_read (inode, buffer_, size, offset, true);
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at position
+   OFFSET, bypassing the cache for whole sectors if DIRECT.
+
+   Holds INODE's lock for reading, which keeps its length and
+   block map from changing underneath us but lets any number of
+   other readers, and writers within the file, run alongside. */
+static off_t
+inode_read (struct inode *inode, void *buffer_, off_t size, off_t offset,
+            bool direct)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
 
+  rw_lock_acquire_read (&inode->rw_lock);
   while (size > 0)
     {
       /* Disk sector to read, starting byte offset within sector. */
@@ -286,50 +494,117 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      cache_read (fs_device, sector_idx, (void *)(buffer + bytes_read),
-                  sector_ofs, chunk_size);
+      if (direct && chunk_size == BLOCK_SECTOR_SIZE)
+        {
+          /* Take in the following whole sectors that are consecutive
+             on disk, so that they are read with a single request. */
+          size_t cnt = 1;
+          while (size - chunk_size >= BLOCK_SECTOR_SIZE
+                 && inode_left - chunk_size >= BLOCK_SECTOR_SIZE
+                 && (byte_to_sector (inode, offset + chunk_size)
+                     == sector_idx + cnt))
+            {
+              chunk_size += BLOCK_SECTOR_SIZE;
+              cnt++;
+            }
+          cache_read_direct (fs_device, sector_idx, cnt, buffer + bytes_read);
+        }
+      else
+        cache_read (fs_device, sector_idx, (void *)(buffer + bytes_read),
+                    sector_ofs, chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
+  rw_lock_release_read (&inode->rw_lock);
 
   return bytes_read;
 }
 
+/* Queues the sectors holding SIZE bytes of INODE, starting at
+   position OFFSET, to be read into the cache in the background.
+   Sectors past the end of INODE are skipped. */
+void
+inode_readahead (struct inode *inode, off_t size, off_t offset)
+{
+  off_t length, end;
+
+  rw_lock_acquire_read (&inode->rw_lock);
+  length = inode_length (inode);
+  end = offset + size < length ? offset + size : length;
+  for (offset -= offset % BLOCK_SECTOR_SIZE; offset < end;
+       offset += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      if (sector_idx != (block_sector_t) -1)
+        cache_readahead (sector_idx);
+    }
+  rw_lock_release_read (&inode->rw_lock);
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if an error occurs.  A write past end of file
+   extends INODE.
+
+   A write that falls within the file holds INODE's lock only for
+   reading, so it runs alongside readers and other such writes,
+   which the cache keeps apart one sector at a time.  A write that
+   extends the file holds the lock for writing throughout, so that
+   nobody sees the new length before the data that fills it. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset)
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
+  bool extending;
 
   if (inode->deny_write_cnt)
     return 0;
 
-  /* If new size of the file is past EOF, extend file */
-  if (byte_to_sector (inode, offset + size - 1) == (size_t)-1)
+  rw_lock_acquire_read (&inode->rw_lock);
+  extending = offset + size > inode->data.length;
+  if (extending)
     {
-      /* Get inode_disk */
-      struct inode_disk *disk_inode = get_inode_disk (inode);
-
-      /* Allocate more sectors */
-      if (!inode_allocate (disk_inode, offset + size))
-        {
-          free (disk_inode);
-          return bytes_written;
-        }
+      /* Trade up for the exclusive lock.  Another writer may have
+         extended the file in the meantime, so check again. */
+      rw_lock_release_read (&inode->rw_lock);
+      rw_lock_acquire_write (&inode->rw_lock);
+      extending = offset + size > inode->data.length;
+    }
 
-      /* Update inode_disk */
-      disk_inode->length = offset + size;
-      cache_write (fs_device, inode_get_inumber (inode), (void *)disk_inode, 0, BLOCK_SECTOR_SIZE);
-      free (disk_inode);
+  /* If new size of the file is past EOF, extend file */
+  if (extending)
+    {
+      /* Allocate more sectors, from the preallocation window if
+         there is one and otherwise right after the last sector of
+         the file, taking a new window too.  Write the inode back
+         even on failure, so that sectors already allocated stay
+         recorded on disk. */
+      struct alloc_cursor cursor;
+      bool success;
+
+      cursor.next = inode->prealloc_next;
+      cursor.left = inode->prealloc_cnt;
+      if (cursor.left == 0)
+        cursor.next = (inode->data.length > 0
+                       ? byte_to_sector (inode, inode->data.length - 1) + 1
+                       : inode->sector + 1);
+      cursor.want = (inode_sector_count (offset + size)
+                     - inode_sector_count (inode->data.length)
+                     + PREALLOC_SECTORS);
+      success = inode_allocate (&inode->data, offset + size, &cursor);
+      inode->prealloc_next = cursor.next;
+      inode->prealloc_cnt = cursor.left;
+      inode_map_invalidate (inode);
+      if (success)
+        inode->data.length = offset + size;
+      inode_write_disk (inode);
+      if (!success)
+        goto done;
     }
 
   while (size > 0)
@@ -357,6 +632,11 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       bytes_written += chunk_size;
     }
 
+ done:
+  if (rw_lock_held_for_write (&inode->rw_lock))
+    rw_lock_release_write (&inode->rw_lock);
+  else
+    rw_lock_release_read (&inode->rw_lock);
   return bytes_written;
 }
 
@@ -380,14 +660,12 @@ inode_allow_write (struct inode *inode)
   inode->deny_write_cnt--;
 }
 
-/* Reads inode_disk from disk. Make sure to free after. */
-struct inode_disk *
-get_inode_disk (const struct inode *inode)
+/* Writes INODE's in-memory inode_disk back to its sector. */
+static void
+inode_write_disk (struct inode *inode)
 {
   ASSERT (inode != NULL);
-  struct inode_disk *disk_inode = malloc (sizeof *disk_inode);
-  cache_read (fs_device, inode_get_inumber (inode), (void *)disk_inode, 0, BLOCK_SECTOR_SIZE);
-  return disk_inode;
+  cache_write (fs_device, inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -395,10 +673,7 @@ off_t
 inode_length (const struct inode *inode)
 {
   ASSERT (inode != NULL);
-  struct inode_disk *disk_inode = get_inode_disk (inode);
-  off_t len = disk_inode->length;
-  free (disk_inode);
-  return len;
+  return inode->data.length;
 }
 
 /* Returns is_dir of INODE's data. */
@@ -406,10 +681,7 @@ bool
 inode_is_dir (const struct inode *inode)
 {
   ASSERT (inode != NULL);
-  struct inode_disk *disk_inode = get_inode_disk (inode);
-  bool is_dir = disk_inode->is_dir;
-  free (disk_inode);
-  return is_dir;
+  return inode->data.is_dir;
 }
 
 /* Returns removed of INODE's data. */
@@ -420,9 +692,74 @@ inode_is_removed (const struct inode *inode)
   return inode->removed;
 }
 
-/* Attempts allocating sectors in the order of direct->indirect->d.indirect */
+/* Acquires the directory lock of INODE, which is shared by every
+   struct dir open on it: exclusively if EXCLUSIVE is true, for
+   changing the directory's entries, otherwise shared with other
+   threads that only read them. */
+void
+inode_acquire_dir_lock (struct inode *inode, bool exclusive)
+{
+  if (exclusive)
+    rw_lock_acquire_write (&inode->dir_lock);
+  else
+    rw_lock_acquire_read (&inode->dir_lock);
+}
+
+/* Releases the directory lock of INODE, however it was acquired. */
+void
+inode_release_dir_lock (struct inode *inode)
+{
+  if (rw_lock_held_for_write (&inode->dir_lock))
+    rw_lock_release_write (&inode->dir_lock);
+  else
+    rw_lock_release_read (&inode->dir_lock);
+}
+
+/* Returns the number of sectors in the runs of consecutive
+   sectors that hold INODE's data, and stores the number of runs
+   into *EXTENT_CNT. */
+size_t
+inode_extents (struct inode *inode, size_t *extent_cnt)
+{
+  size_t sector_cnt;
+  block_sector_t prev = -1;
+  size_t i;
+
+  rw_lock_acquire_read (&inode->rw_lock);
+  sector_cnt = bytes_to_sectors (inode_length (inode));
+  *extent_cnt = 0;
+  for (i = 0; i < sector_cnt; i++)
+    {
+      block_sector_t sector = byte_to_sector (inode, i * BLOCK_SECTOR_SIZE);
+      if (i == 0 || sector != prev + 1)
+        (*extent_cnt)++;
+      prev = sector;
+    }
+  rw_lock_release_read (&inode->rw_lock);
+  return sector_cnt;
+}
+
+/* Returns the number of sectors, counting indirect blocks, that
+   an inode LENGTH bytes long uses besides its own. */
+static size_t
+inode_sector_count (off_t length)
+{
+  size_t data = bytes_to_sectors (length);
+  size_t cnt = data;
+
+  if (data > DIRECT_BLOCK_COUNT)
+    cnt++;
+  if (data > DIRECT_BLOCK_COUNT + INDIRECT_BLOCK_COUNT)
+    cnt += 1 + DIV_ROUND_UP (data - DIRECT_BLOCK_COUNT - INDIRECT_BLOCK_COUNT,
+                             INDIRECT_BLOCK_COUNT);
+  return cnt;
+}
+
+/* Attempts allocating sectors in the order of direct->indirect->d.indirect,
+   taking them from CURSOR. */
 static bool
-inode_allocate (struct inode_disk *disk_inode, off_t length)
+inode_allocate (struct inode_disk *disk_inode, off_t length,
+                struct alloc_cursor *cursor)
 {
   ASSERT (disk_inode != NULL);
   if (length < 0) return false;
@@ -433,21 +770,22 @@ inode_allocate (struct inode_disk *disk_inode, off_t length)
   /* Allocate Direct Blocks */
   j = min (num_sectors, DIRECT_BLOCK_COUNT);
   for (i = 0; i < j; i++)
-    if (!inode_allocate_sector (&disk_inode->direct_blocks[i]))
+    if (!inode_allocate_sector (&disk_inode->direct_blocks[i], cursor))
       return false;
   num_sectors -= j;
   if (num_sectors == 0) return true;
 
   /* Allocate Indirect Block */
   j = min (num_sectors, INDIRECT_BLOCK_COUNT);
-  if (!inode_allocate_indirect (&disk_inode->indirect_block, j))
+  if (!inode_allocate_indirect (&disk_inode->indirect_block, j, cursor))
     return false;
   num_sectors -= j;
   if (num_sectors == 0) return true;
 
   /* Allocate Doubly-Indirect Block */
   j = min (num_sectors, INDIRECT_BLOCK_COUNT * INDIRECT_BLOCK_COUNT);
-  if (!inode_allocate_doubly_indirect (&disk_inode->doubly_indirect_block, j))
+  if (!inode_allocate_doubly_indirect (&disk_inode->doubly_indirect_block, j,
+                                       cursor))
     return false;
   num_sectors -= j;
   if (num_sectors == 0) return true;
@@ -457,24 +795,40 @@ inode_allocate (struct inode_disk *disk_inode, off_t length)
   return false;
 }
 
+/* Allocates *SECTOR_NUM from CURSOR if it is not allocated yet,
+   refilling CURSOR's run from the free map if it is empty. */
 static bool
-inode_allocate_sector (block_sector_t *sector_num)
+inode_allocate_sector (block_sector_t *sector_num,
+                       struct alloc_cursor *cursor)
 {
   static char buffer[BLOCK_SECTOR_SIZE];
   if (!*sector_num)
     {
-      if (!free_map_allocate (1, sector_num))
-        return false;
+      if (cursor->left == 0)
+        {
+          cursor->left = free_map_allocate_run (cursor->next,
+                                                cursor->want > 0
+                                                ? cursor->want : 1,
+                                                &cursor->next);
+          if (cursor->left == 0)
+            return false;
+        }
+      *sector_num = cursor->next++;
+      cursor->left--;
+      if (cursor->want > 0)
+        cursor->want--;
       cache_write (fs_device, *sector_num, buffer, 0, BLOCK_SECTOR_SIZE);
     }
   return true;
 }
 
 static bool
-inode_allocate_indirect (block_sector_t *sector_num, size_t cnt)
+inode_allocate_indirect (block_sector_t *sector_num, size_t cnt,
+                         struct alloc_cursor *cursor)
 {
-  /* Allocate indirect block sector if it hasn't been */
-  if (!inode_allocate_sector (sector_num))
+  /* Allocate indirect block sector if it hasn't been, just before
+     the data it points to */
+  if (!inode_allocate_sector (sector_num, cursor))
     return false;
 
   /* Read in the indirect block from cache */
@@ -484,7 +838,7 @@ inode_allocate_indirect (block_sector_t *sector_num, size_t cnt)
   /* Allocate number of sectors needed */
   size_t i;
   for (i = 0; i < cnt; i++)
-    if (!inode_allocate_sector (&indirect_block.block[i]))
+    if (!inode_allocate_sector (&indirect_block.block[i], cursor))
       return false;
 
   /* Write to disk */
@@ -494,10 +848,11 @@ inode_allocate_indirect (block_sector_t *sector_num, size_t cnt)
 }
 
 static bool
-inode_allocate_doubly_indirect (block_sector_t *sector_num, size_t cnt)
+inode_allocate_doubly_indirect (block_sector_t *sector_num, size_t cnt,
+                                struct alloc_cursor *cursor)
 {
   /* Allocate doubly-indirect block sector if it hasn't been */
-  if (!inode_allocate_sector (sector_num))
+  if (!inode_allocate_sector (sector_num, cursor))
     return false;
 
   /* Read in the indirect block from cache */
@@ -509,7 +864,8 @@ inode_allocate_doubly_indirect (block_sector_t *sector_num, size_t cnt)
   for (i = 0; i < j; i++)
     {
       num_sectors = min (cnt, INDIRECT_BLOCK_COUNT);
-      if (!inode_allocate_indirect (&indirect_block.block[i], num_sectors))
+      if (!inode_allocate_indirect (&indirect_block.block[i], num_sectors,
+                                    cursor))
         return false;
       cnt -= num_sectors;
     }
@@ -526,7 +882,7 @@ inode_deallocate (struct inode *inode)
   ASSERT (inode != NULL);
 
   /* Get inode_disk length in bytes */
-  struct inode_disk *disk_inode = get_inode_disk (inode);
+  struct inode_disk *disk_inode = &inode->data;
   off_t length = disk_inode->length;
   if (length < 0) return;
 
@@ -539,27 +895,20 @@ inode_deallocate (struct inode *inode)
     free_map_release (disk_inode->direct_blocks[i], 1);
   num_sectors -= j;
   if (num_sectors == 0)
-    {
-      free (disk_inode);
-      return;
-    }
+    return;
 
   /* Deallocate indirect block */
   j = min (num_sectors, INDIRECT_BLOCK_COUNT);
   inode_deallocate_indirect (disk_inode->indirect_block, j);
   num_sectors -= j;
   if (num_sectors == 0)
-    {
-      free (disk_inode);
-      return;
-    }
+    return;
 
   /* Deallocate doubly indirect block */
   j = min (num_sectors, INDIRECT_BLOCK_COUNT * INDIRECT_BLOCK_COUNT);
   inode_deallocate_doubly_indirect (disk_inode->doubly_indirect_block, j);
   num_sectors -= j;
 
-  free (disk_inode);
   ASSERT (num_sectors == 0);
 }
 
@@ -592,17 +941,3 @@ inode_deallocate_doubly_indirect (block_sector_t sector_num, size_t cnt)
 
   free_map_release (sector_num, 1);
 }
-
-/* Acquire the lock of INODE. */
-void
-inode_acquire_lock (struct inode *inode)
-{
-  lock_acquire (&(inode->inode_lock));
-}
-
-/* Release the lock of INODE. */
-void
-inode_release_lock (struct inode *inode)
-{
-  lock_release (&(inode->inode_lock));
-}
@@ -2,12 +2,14 @@
 #define FILESYS_INODE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
 #include "devices/block.h"
 
 struct bitmap;
 
 void inode_init (void);
+void inode_print_stats (void);
 bool inode_create (block_sector_t, off_t, bool);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
@@ -15,15 +17,16 @@ block_sector_t inode_get_inumber (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
+off_t inode_read_at_direct (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+void inode_readahead (struct inode *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
-struct inode_disk *get_inode_disk (const struct inode *);
 off_t inode_length (const struct inode *);
 bool inode_is_dir (const struct inode *);
 bool inode_is_removed (const struct inode *);
-
-void inode_acquire_lock (struct inode *inode);
-void inode_release_lock (struct inode *inode);
+void inode_acquire_dir_lock (struct inode *, bool exclusive);
+void inode_release_dir_lock (struct inode *);
+size_t inode_extents (struct inode *, size_t *extent_cnt);
 
 #endif /* filesys/inode.h */
@@ -21,13 +21,26 @@ typedef unsigned long elem_type;
 /* Number of bits in an element. */
 #define ELEM_BITS (sizeof (elem_type) * CHAR_BIT)
 
+/* Number of bits in a summary group.  Must be a multiple of
+   ELEM_BITS, and small enough for the count of set bits in a
+   group to fit in a summary_type. */
+#define GROUP_BITS 4096
+typedef uint16_t summary_type;
+
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.
+
+   A bitmap may also have a summary, which counts the bits set in
+   each group of GROUP_BITS bits.  bitmap_scan() uses it to skip
+   over whole groups that cannot hold the bits it looks for.  The
+   counts are kept exact only if changes to the bitmap are
+   serialized by the caller, as palloc and the free map do. */
 struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+    summary_type *summary;      /* Set bits per group, or null. */
   };
 
 /* Returns the index of the element that contains the bit
@@ -69,6 +82,61 @@ last_mask (const struct bitmap *b)
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns the number of summary groups required for BIT_CNT
+   bits. */
+static inline size_t
+group_cnt (size_t bit_cnt)
+{
+  return DIV_ROUND_UP (bit_cnt, GROUP_BITS);
+}
+
+/* Returns the number of bits in group GROUP of B, which is
+   GROUP_BITS except possibly for the last group. */
+static inline size_t
+group_size (const struct bitmap *b, size_t group)
+{
+  size_t first = group * GROUP_BITS;
+  return b->bit_cnt - first < GROUP_BITS ? b->bit_cnt - first : GROUP_BITS;
+}
+
+/* Returns the number of bits set in ELEM. */
+static inline unsigned
+elem_popcount (elem_type elem)
+{
+  unsigned cnt = 0;
+  for (; elem != 0; elem &= elem - 1)
+    cnt++;
+  return cnt;
+}
+
+/* Adds DELTA to the count of set bits in the summary group of
+   BIT_IDX in B, if B has a summary. */
+static inline void
+summary_add (struct bitmap *b, size_t bit_idx, int delta)
+{
+  if (b->summary != NULL)
+    b->summary[bit_idx / GROUP_BITS] += delta;
+}
+
+/* Recomputes B's summary, if it has one, from B's bits. */
+static void
+summary_rebuild (struct bitmap *b)
+{
+  size_t i;
+
+  if (b->summary == NULL)
+    return;
+  for (i = 0; i < group_cnt (b->bit_cnt); i++)
+    b->summary[i] = 0;
+  for (i = 0; i < elem_cnt (b->bit_cnt); i++)
+    {
+      elem_type elem = b->bits[i];
+      if (i == elem_cnt (b->bit_cnt) - 1)
+        elem &= last_mask (b);
+      b->summary[i * ELEM_BITS / GROUP_BITS] += elem_popcount (elem);
+    }
+}
+
 /* Creation and destruction. */
 
 /* Creates and returns a pointer to a newly allocated bitmap with room for
@@ -82,6 +150,7 @@ bitmap_create (size_t bit_cnt)
   if (b != NULL)
     {
       b->bit_cnt = bit_cnt;
+      b->summary = NULL;
       b->bits = malloc (byte_cnt (bit_cnt));
       if (b->bits != NULL || bit_cnt == 0)
         {
@@ -95,7 +164,8 @@ bitmap_create (size_t bit_cnt)
 
 /* Creates and returns a bitmap with BIT_CNT bits in the
    BLOCK_SIZE bytes of storage preallocated at BLOCK.
-   BLOCK_SIZE must be at least bitmap_needed_bytes(BIT_CNT). */
+   BLOCK_SIZE must be at least bitmap_needed_bytes(BIT_CNT).
+   The bitmap has a summary, also stored in BLOCK. */
 struct bitmap *
 bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 {
@@ -105,6 +175,8 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 
   b->bit_cnt = bit_cnt;
   b->bits = (elem_type *) (b + 1);
+  b->summary = (summary_type *) (b->bits + elem_cnt (bit_cnt));
+  summary_rebuild (b);
   bitmap_set_all (b, false);
   return b;
 }
@@ -114,7 +186,28 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 size_t
 bitmap_buf_size (size_t bit_cnt)
 {
-  return sizeof (struct bitmap) + byte_cnt (bit_cnt);
+  return (sizeof (struct bitmap) + byte_cnt (bit_cnt)
+          + group_cnt (bit_cnt) * sizeof (summary_type));
+}
+
+/* Gives B a summary, if it does not have one, so that
+   bitmap_scan() can skip groups of bits that cannot match.
+   Returns true if successful, false if memory allocation fails.
+   Not for use on bitmaps created by bitmap_create_in_buf(),
+   which always have one. */
+bool
+bitmap_enable_summary (struct bitmap *b)
+{
+  ASSERT (b != NULL);
+
+  if (b->summary == NULL)
+    {
+      b->summary = malloc (group_cnt (b->bit_cnt) * sizeof *b->summary);
+      if (b->summary == NULL && b->bit_cnt > 0)
+        return false;
+      summary_rebuild (b);
+    }
+  return true;
 }
 
 /* Destroys bitmap B, freeing its storage.
@@ -124,6 +217,7 @@ bitmap_destroy (struct bitmap *b)
 {
   if (b != NULL)
     {
+      free (b->summary);
       free (b->bits);
       free (b);
     }
@@ -157,12 +251,17 @@ void
 bitmap_mark (struct bitmap *b, size_t bit_idx)
 {
   size_t idx = elem_idx (bit_idx);
-  elem_type mask = bit_mask (bit_idx);
-
-  /* This is equivalent to `b->bits[idx] |= mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the OR instruction in [IA32-v2b]. */
-  asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  elem_type bit = bit_idx % ELEM_BITS;
+  bool was_set;
+
+  /* This is equivalent to `b->bits[idx] |= bit_mask (bit_idx)'
+     except that it is guaranteed to be atomic on a uniprocessor
+     machine and tells us the bit's old value.  See the
+     description of the BTS instruction in [IA32-v2a]. */
+  asm ("btsl %2, %0; setc %1"
+       : "+m" (b->bits[idx]), "=qm" (was_set) : "r" (bit) : "cc");
+  if (!was_set)
+    summary_add (b, bit_idx, 1);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -170,12 +269,17 @@ void
 bitmap_reset (struct bitmap *b, size_t bit_idx)
 {
   size_t idx = elem_idx (bit_idx);
-  elem_type mask = bit_mask (bit_idx);
-
-  /* This is equivalent to `b->bits[idx] &= ~mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the AND instruction in [IA32-v2a]. */
-  asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  elem_type bit = bit_idx % ELEM_BITS;
+  bool was_set;
+
+  /* This is equivalent to `b->bits[idx] &= ~bit_mask (bit_idx)'
+     except that it is guaranteed to be atomic on a uniprocessor
+     machine and tells us the bit's old value.  See the
+     description of the BTR instruction in [IA32-v2a]. */
+  asm ("btrl %2, %0; setc %1"
+       : "+m" (b->bits[idx]), "=qm" (was_set) : "r" (bit) : "cc");
+  if (was_set)
+    summary_add (b, bit_idx, -1);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -185,12 +289,16 @@ void
 bitmap_flip (struct bitmap *b, size_t bit_idx)
 {
   size_t idx = elem_idx (bit_idx);
-  elem_type mask = bit_mask (bit_idx);
-
-  /* This is equivalent to `b->bits[idx] ^= mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the XOR instruction in [IA32-v2b]. */
-  asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  elem_type bit = bit_idx % ELEM_BITS;
+  bool was_set;
+
+  /* This is equivalent to `b->bits[idx] ^= bit_mask (bit_idx)'
+     except that it is guaranteed to be atomic on a uniprocessor
+     machine and tells us the bit's old value.  See the
+     description of the BTC instruction in [IA32-v2a]. */
+  asm ("btcl %2, %0; setc %1"
+       : "+m" (b->bits[idx]), "=qm" (was_set) : "r" (bit) : "cc");
+  summary_add (b, bit_idx, was_set ? -1 : 1);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -288,23 +396,73 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 
 /* Finding set or unset bits. */
 
+/* Returns the index of the first bit in B at or after START that
+   is set to VALUE, or B's size if there is none.  Skips whole
+   elements, and whole summary groups if B has a summary, that do
+   not contain such a bit. */
+static size_t
+find_next (const struct bitmap *b, size_t start, bool value)
+{
+  size_t i = start;
+
+  while (i < b->bit_cnt)
+    {
+      size_t idx = elem_idx (i);
+      elem_type elem;
+
+      /* At the start of a group with no bit set to VALUE, skip the
+         group. */
+      if (b->summary != NULL && i % GROUP_BITS == 0)
+        {
+          size_t group = i / GROUP_BITS;
+          size_t set = b->summary[group];
+          if (set == (value ? 0 : group_size (b, group)))
+            {
+              i += GROUP_BITS;
+              continue;
+            }
+        }
+
+      /* Bits set to VALUE in this element, at or after I. */
+      elem = value ? b->bits[idx] : ~b->bits[idx];
+      elem &= (elem_type) -1 << (i % ELEM_BITS);
+      if (elem != 0)
+        {
+          i = idx * ELEM_BITS + __builtin_ctzl (elem);
+          return i < b->bit_cnt ? i : b->bit_cnt;
+        }
+      i = (idx + 1) * ELEM_BITS;
+    }
+  return b->bit_cnt;
+}
+
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+
+   Works an element at a time: finds the next bit set to VALUE,
+   then the end of the run of such bits that it starts, and moves
+   on past the run if it is too short. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
 {
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt)
+  if (cnt == 0)
+    return start;
+  while (cnt <= b->bit_cnt - start)
     {
-      size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i;
+      size_t run_end;
+
+      start = find_next (b, start, value);
+      if (cnt > b->bit_cnt - start)
+        break;
+      run_end = find_next (b, start, !value);
+      if (run_end - start >= cnt)
+        return start;
+      start = run_end;
     }
   return BITMAP_ERROR;
 }
@@ -347,6 +505,7 @@ bitmap_read (struct bitmap *b, struct file *file)
       printf("In bitmap_read()\n");
       success = file_read_at (file, b->bits, size, 0) == size;
       b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+      summary_rebuild (b);
     }
   return success;
 }
@@ -359,6 +518,24 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the SIZE bytes starting at byte offset OFS of B's file
+   image, as written by bitmap_write(), to the same place in FILE.
+   The range is trimmed to the end of the image.  Returns true if
+   successful, false otherwise. */
+bool
+bitmap_write_range (const struct bitmap *b, struct file *file,
+                    size_t ofs, size_t size)
+{
+  size_t file_size = byte_cnt (b->bit_cnt);
+
+  if (ofs >= file_size)
+    return true;
+  if (size > file_size - ofs)
+    size = file_size - ofs;
+  return (file_write_at (file, (const uint8_t *) b->bits + ofs, size, ofs)
+          == (off_t) size);
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -0,0 +1,133 @@
+#include "heap.h"
+#include "../debug.h"
+
+static struct heap_elem *link (struct heap *,
+                               struct heap_elem *, struct heap_elem *);
+static struct heap_elem *merge_pairs (struct heap *, struct heap_elem *);
+
+/* Initializes heap H to be empty, ordered by LESS given
+   auxiliary data AUX. */
+void
+heap_init (struct heap *h, heap_less_func *less, void *aux)
+{
+  ASSERT (h != NULL);
+  ASSERT (less != NULL);
+
+  h->root = NULL;
+  h->elem_cnt = 0;
+  h->less = less;
+  h->aux = aux;
+}
+
+/* Inserts E into heap H, in constant time. */
+void
+heap_push (struct heap *h, struct heap_elem *e)
+{
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  e->child = e->next = NULL;
+  h->root = h->root != NULL ? link (h, h->root, e) : e;
+  h->elem_cnt++;
+}
+
+/* Returns the least element in heap H, or a null pointer if H is
+   empty.  If several elements are least, returns one of them. */
+struct heap_elem *
+heap_min (const struct heap *h)
+{
+  ASSERT (h != NULL);
+
+  return h->root;
+}
+
+/* Removes the least element from heap H and returns it, or
+   returns a null pointer if H is empty.  Takes amortized time
+   logarithmic in the size of H. */
+struct heap_elem *
+heap_pop_min (struct heap *h)
+{
+  struct heap_elem *min;
+
+  ASSERT (h != NULL);
+
+  min = h->root;
+  if (min != NULL)
+    {
+      h->root = merge_pairs (h, min->child);
+      h->elem_cnt--;
+    }
+  return min;
+}
+
+/* Returns the number of elements in H. */
+size_t
+heap_size (const struct heap *h)
+{
+  return h->elem_cnt;
+}
+
+/* Returns true if H contains no elements, false otherwise. */
+bool
+heap_empty (const struct heap *h)
+{
+  return h->root == NULL;
+}
+
+/* Makes the greater of trees A and B, neither of which may have
+   siblings, the first child of the lesser, and returns the
+   lesser. */
+static struct heap_elem *
+link (struct heap *h, struct heap_elem *a, struct heap_elem *b)
+{
+  if (h->less (b, a, h->aux))
+    {
+      struct heap_elem *t = a;
+      a = b;
+      b = t;
+    }
+  b->next = a->child;
+  a->child = b;
+  return a;
+}
+
+/* Combines the list of sibling trees starting at FIRST into a
+   single tree and returns its root, or a null pointer if the list
+   is empty.  Links the trees in pairs from left to right, then
+   links the pairs together from right to left, which is what
+   keeps the heap shallow. */
+static struct heap_elem *
+merge_pairs (struct heap *h, struct heap_elem *first)
+{
+  struct heap_elem *pairs = NULL;
+  struct heap_elem *root = NULL;
+
+  /* First pass: link adjacent trees, stacking up the results so
+     that the rightmost pair ends up on top. */
+  while (first != NULL)
+    {
+      struct heap_elem *a = first;
+      struct heap_elem *b = a->next;
+
+      if (b != NULL)
+        {
+          first = b->next;
+          a->next = b->next = NULL;
+          a = link (h, a, b);
+        }
+      else
+        first = NULL;
+      a->next = pairs;
+      pairs = a;
+    }
+
+  /* Second pass: link the pairs, from the rightmost one back. */
+  while (pairs != NULL)
+    {
+      struct heap_elem *next = pairs->next;
+      pairs->next = NULL;
+      root = root != NULL ? link (h, root, pairs) : pairs;
+      pairs = next;
+    }
+  return root;
+}
@@ -33,6 +33,9 @@ enum
     SYS_INVCACHE,               /* Invalidates the cache. */
     SYS_CACHESTAT,              /* Returns the cache access, hit, and miss counts. */
     SYS_DISKSTAT,               /* Returns the disk read and write counts. */
+    SYS_PREFETCHSTAT,           /* Returns the cache read-ahead hit and miss counts. */
+    SYS_OPEN_FLAGS,             /* Opens a file with OPEN_* flags. */
+    SYS_READDIR_MANY,           /* Reads several directory entries. */
 
     /* Student add-on. */
     NUM_SYSCALLS                /* Size of enum (number of system calls). */
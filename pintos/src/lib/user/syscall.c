@@ -206,3 +206,21 @@ diskstat (const long long *read_count, const long long *write_count)
 {
   return syscall2 (SYS_DISKSTAT, read_count, write_count);
 }
+
+int
+prefetchstat (const long long *hit_count, const long long *miss_count)
+{
+  return syscall2 (SYS_PREFETCHSTAT, hit_count, miss_count);
+}
+
+int
+open_flags (const char *file, int flags)
+{
+  return syscall2 (SYS_OPEN_FLAGS, file, flags);
+}
+
+int
+readdir_many (int fd, struct readdir_entry *entries, int cnt)
+{
+  return syscall3 (SYS_READDIR_MANY, fd, entries, cnt);
+}
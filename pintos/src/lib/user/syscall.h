@@ -15,6 +15,17 @@ typedef int mapid_t;
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
+/* A directory entry written by readdir_many(). */
+struct readdir_entry
+  {
+    char name[READDIR_MAX_LEN + 1];     /* Null terminated file name. */
+    int inumber;                        /* Inode number. */
+    bool is_dir;                        /* Directory? */
+  };
+
+/* Flags for open_flags(). */
+#define OPEN_DIRECT 0x1         /* Read whole sectors around the cache. */
+
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
@@ -49,5 +60,8 @@ void invcache (void);
 int cachestat (const long long *access_count, const long long *hit_count, 
                const long long *miss_count);
 int diskstat (const long long *read_count, const long long *write_count);
+int prefetchstat (const long long *hit_count, const long long *miss_count);
+int open_flags (const char *file, int flags);
+int readdir_many (int fd, struct readdir_entry *, int cnt);
 
 #endif /* lib/user/syscall.h */
@@ -2,7 +2,15 @@
 use strict;
 use warnings;
 use tests::tests;
-check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The exact hit rates depend on the cache size chosen at boot.  The
+# test itself fails if the second read did not improve on the first.
+s/hit rate percent: \d+/hit rate percent: N/g foreach @output;
+
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@output, [<<'EOF']);
 (bm-cache) begin
 (bm-cache) create "cache_test"
 (bm-cache) open "cache_test"
@@ -17,8 +25,12 @@ check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
 (bm-cache) open "cache_test"
 (bm-cache) read 16384 bytes from "cache_test"
 (bm-cache) cachestat
-(bm-cache) old hit rate percent: 65, new hit rate percent: 98
+(bm-cache) old hit rate percent: N, new hit rate percent: N
+(bm-cache) baseline disk statistics
+(bm-cache) cachestat
+(bm-cache) diskstat
+(bm-cache) 2048 hot lookups hit in cache without disk reads
 (bm-cache) close "cache_test"
 (bm-cache) end
 EOF
-pass;
\ No newline at end of file
+pass;
@@ -0,0 +1,69 @@
+/* Benchmarks a large directory by doing the following:
+   Creates 10,000 empty files in one directory, which converts it
+   from a linear directory to a hashed one along the way, opens
+   each of them by name, checks that readdir() returns each name
+   once, and then removes them all and removes the directory. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 10000
+
+static char seen[FILE_CNT];
+
+void
+test_main (void)
+{
+  char name[READDIR_MAX_LEN + 1];
+  int fd, cnt, i;
+
+  CHECK (mkdir ("big"), "mkdir \"big\"");
+  CHECK (chdir ("big"), "chdir \"big\"");
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\"", name);
+    }
+  msg ("created %d files", FILE_CNT);
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      if ((fd = open (name)) < 2)
+        fail ("open \"%s\"", name);
+      close (fd);
+    }
+  msg ("looked up %d files", FILE_CNT);
+
+  CHECK ((fd = open (".")) > 1, "open \".\"");
+  cnt = 0;
+  while (readdir (fd, name))
+    {
+      if (memcmp (name, "file", 4)
+          || (i = atoi (name + 4)) < 0 || i >= FILE_CNT || seen[i])
+        fail ("readdir returned unexpected \"%s\"", name);
+      seen[i] = 1;
+      cnt++;
+    }
+  close (fd);
+  if (cnt != FILE_CNT)
+    fail ("readdir returned %d names, expected %d", cnt, FILE_CNT);
+  msg ("read %d names", FILE_CNT);
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      if (!remove (name))
+        fail ("remove \"%s\"", name);
+    }
+  msg ("removed %d files", FILE_CNT);
+
+  CHECK (chdir ("/"), "chdir \"/\"");
+  CHECK (remove ("big"), "remove \"big\"");
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(bm-dir-hash) begin
+(bm-dir-hash) mkdir "big"
+(bm-dir-hash) chdir "big"
+(bm-dir-hash) created 10000 files
+(bm-dir-hash) looked up 10000 files
+(bm-dir-hash) open "."
+(bm-dir-hash) read 10000 names
+(bm-dir-hash) removed 10000 files
+(bm-dir-hash) chdir "/"
+(bm-dir-hash) remove "big"
+(bm-dir-hash) end
+EOF
+pass;
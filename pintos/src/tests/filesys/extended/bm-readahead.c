@@ -0,0 +1,68 @@
+/* Tests sequential read-ahead by doing the following:
+   Writes a file much larger than the read-ahead window, closes and
+   reopens it, and invalidates the cache.  Then reads the file from
+   start to end one sector at a time, so that every read begins
+   where the previous one ended, and checks that some of those
+   reads were served by blocks the cache had already read ahead.
+   Finally it checks that the data read back is what was written. */
+
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_SECTOR_SIZE 512
+#define BUF_SIZE (BLOCK_SECTOR_SIZE * 128)
+
+static char buf[BUF_SIZE];
+static char readback[BUF_SIZE];
+static long long num_prefetch_hits;
+static long long num_prefetch_misses;
+
+void
+test_main (void)
+{
+  int test_fd;
+  int ofs;
+  char *file_name = "readahead_test";
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((test_fd = open (file_name)) > 1, "open \"%s\"", file_name);
+
+  random_bytes (buf, sizeof buf);
+  CHECK (write (test_fd, buf, sizeof buf) == BUF_SIZE,
+   "write %d bytes to \"%s\"", (int) BUF_SIZE, file_name);
+
+  /* Close file and reopen */
+  close (test_fd);
+  msg ("close \"%s\"", file_name);
+  CHECK ((test_fd = open (file_name)) > 1, "open \"%s\"", file_name);
+
+  /* Invalidate cache */
+  invcache ();
+  msg ("invcache");
+
+  CHECK (prefetchstat (&num_prefetch_hits, &num_prefetch_misses) == 0,
+    "baseline prefetch statistics");
+  long long base_prefetch_hits = num_prefetch_hits;
+
+  /* Read the file sequentially, one sector per call. */
+  for (ofs = 0; ofs < BUF_SIZE; ofs += BLOCK_SECTOR_SIZE)
+    if (read (test_fd, readback + ofs, BLOCK_SECTOR_SIZE) != BLOCK_SECTOR_SIZE)
+      fail ("read %d bytes at offset %d of \"%s\"",
+            BLOCK_SECTOR_SIZE, ofs, file_name);
+  msg ("read \"%s\" sequentially", file_name);
+
+  CHECK (prefetchstat (&num_prefetch_hits, &num_prefetch_misses) == 0,
+    "prefetchstat");
+  CHECK (num_prefetch_hits > base_prefetch_hits,
+    "sequential reads hit blocks read ahead");
+
+  if (memcmp (buf, readback, BUF_SIZE))
+    fail ("data read back from \"%s\" differs from data written", file_name);
+  msg ("verified contents of \"%s\"", file_name);
+
+  msg ("close \"%s\"", file_name);
+  close (test_fd);
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(bm-readahead) begin
+(bm-readahead) create "readahead_test"
+(bm-readahead) open "readahead_test"
+(bm-readahead) write 65536 bytes to "readahead_test"
+(bm-readahead) close "readahead_test"
+(bm-readahead) open "readahead_test"
+(bm-readahead) invcache
+(bm-readahead) baseline prefetch statistics
+(bm-readahead) read "readahead_test" sequentially
+(bm-readahead) prefetchstat
+(bm-readahead) sequential reads hit blocks read ahead
+(bm-readahead) verified contents of "readahead_test"
+(bm-readahead) close "readahead_test"
+(bm-readahead) end
+EOF
+pass;
@@ -0,0 +1,49 @@
+/* Child process for syn-read-many.
+   Reads the first BUF_SIZE bytes of the file created by our parent
+   PASS_CNT times over, one sector per read, and checks that they
+   are what the parent wrote each time. */
+
+#include <random.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/filesys/extended/syn-read-many.h"
+#include "tests/lib.h"
+
+const char *test_name = "child-read-many";
+
+static char buf[BUF_SIZE];
+static char readback[BLOCK_SECTOR_SIZE];
+
+int
+main (int argc, const char *argv[])
+{
+  int child_idx;
+  int pass;
+  size_t ofs;
+  int fd;
+
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (pass = 0; pass < PASS_CNT; pass++)
+    {
+      seek (fd, 0);
+      for (ofs = 0; ofs < BUF_SIZE; ofs += BLOCK_SECTOR_SIZE)
+        {
+          CHECK (read (fd, readback, BLOCK_SECTOR_SIZE) == BLOCK_SECTOR_SIZE,
+                 "read %d bytes at offset %zu of \"%s\"",
+                 BLOCK_SECTOR_SIZE, ofs, file_name);
+          compare_bytes (readback, buf + ofs, BLOCK_SECTOR_SIZE, ofs,
+                         file_name);
+        }
+    }
+  close (fd);
+
+  return child_idx;
+}
@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($fs);
+$fs->{'a'}{"file$_"} = [''] foreach 0...59;
+$fs->{'a'}{'sub'} = {};
+check_archive ($fs);
+pass;
@@ -0,0 +1,84 @@
+/* Creates 60 files and a subdirectory in a directory, enough to
+   make it a hashed directory, and reads them back with
+   readdir_many() a few at a time.  Checks that each name comes
+   back once, with the right type and inode number. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 60
+
+static bool seen[FILE_CNT + 1];
+
+/* Returns the inode number of NAME in "a". */
+static int
+inumber_of (const char *name)
+{
+  char path[READDIR_MAX_LEN + 3] = "a/";
+  int fd, inum;
+
+  strlcat (path, name, sizeof path);
+  if ((fd = open (path)) < 2)
+    fail ("open \"%s\"", path);
+  inum = inumber (fd);
+  close (fd);
+  return inum;
+}
+
+void
+test_main (void)
+{
+  struct readdir_entry entries[7];
+  char name[READDIR_MAX_LEN + 1];
+  int fd, cnt, total, i;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "a/file%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\"", name);
+    }
+  msg ("created %d files", FILE_CNT);
+  CHECK (mkdir ("a/sub"), "mkdir \"a/sub\"");
+
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  total = 0;
+  while ((cnt = readdir_many (fd, entries, 7)) > 0)
+    for (i = 0; i < cnt; i++)
+      {
+        struct readdir_entry *e = &entries[i];
+        int idx;
+
+        if (!strcmp (e->name, "sub"))
+          {
+            idx = FILE_CNT;
+            if (!e->is_dir)
+              fail ("\"sub\" not reported as a directory");
+          }
+        else
+          {
+            idx = atoi (e->name + 4);
+            if (memcmp (e->name, "file", 4) || idx < 0 || idx >= FILE_CNT)
+              fail ("unexpected name \"%s\"", e->name);
+            if (e->is_dir)
+              fail ("\"%s\" reported as a directory", e->name);
+          }
+        if (seen[idx])
+          fail ("\"%s\" returned twice", e->name);
+        seen[idx] = true;
+        if (e->inumber != inumber_of (e->name))
+          fail ("wrong inumber for \"%s\"", e->name);
+        total++;
+      }
+  if (cnt < 0)
+    fail ("readdir_many failed");
+  if (total != FILE_CNT + 1)
+    fail ("readdir_many returned %d names, expected %d", total, FILE_CNT + 1);
+  msg ("readdir_many returned each name once");
+  close (fd);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-readdir-many) begin
+(dir-readdir-many) mkdir "a"
+(dir-readdir-many) created 60 files
+(dir-readdir-many) mkdir "a/sub"
+(dir-readdir-many) open "a"
+(dir-readdir-many) readdir_many returned each name once
+(dir-readdir-many) end
+EOF
+pass;
@@ -0,0 +1,49 @@
+/* Writes a file many sectors long, empties the cache, and then
+   reads the whole file back with one read() on a file opened with
+   OPEN_DIRECT, so that its sectors are read from disk straight
+   into the user buffer's place.  Verifies that the data comes back
+   intact and that it was read from disk. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_SECTOR_SIZE 512
+#define FILE_SIZE (BLOCK_SECTOR_SIZE * 40)
+
+static char buf[FILE_SIZE];
+static char check[FILE_SIZE];
+
+void
+test_main (void)
+{
+  const char *file_name = "direct";
+  long long disk_reads, base_disk_reads, disk_writes;
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, sizeof buf) == FILE_SIZE,
+         "write %d bytes to \"%s\"", FILE_SIZE, file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  invcache ();
+  msg ("invcache");
+
+  CHECK ((fd = open_flags (file_name, OPEN_DIRECT)) > 1,
+         "open \"%s\" with OPEN_DIRECT", file_name);
+  CHECK (diskstat (&base_disk_reads, &disk_writes) == 0,
+         "baseline disk statistics");
+  CHECK (read (fd, check, sizeof check) == FILE_SIZE,
+         "read %d bytes from \"%s\"", FILE_SIZE, file_name);
+  compare_bytes (check, buf, sizeof buf, 0, file_name);
+  CHECK (diskstat (&disk_reads, &disk_writes) == 0, "diskstat");
+  if (disk_reads - base_disk_reads < FILE_SIZE / BLOCK_SECTOR_SIZE)
+    fail ("only %lld sectors read from disk, expected at least %d",
+          disk_reads - base_disk_reads, FILE_SIZE / BLOCK_SECTOR_SIZE);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
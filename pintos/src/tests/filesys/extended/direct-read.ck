@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(direct-read) begin
+(direct-read) create "direct"
+(direct-read) open "direct"
+(direct-read) write 20480 bytes to "direct"
+(direct-read) close "direct"
+(direct-read) invcache
+(direct-read) open "direct" with OPEN_DIRECT
+(direct-read) baseline disk statistics
+(direct-read) read 20480 bytes from "direct"
+(direct-read) diskstat
+(direct-read) close "direct"
+(direct-read) end
+EOF
+pass;
@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+check_archive ({"child-read-many" => "tests/filesys/extended/child-read-many",
+		"shared" => [random_bytes (16384 + 4096)]});
+pass;
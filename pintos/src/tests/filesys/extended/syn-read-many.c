@@ -0,0 +1,54 @@
+/* Spawns several child processes that all read the same file at
+   once, many times over, one sector per read.  Meanwhile the
+   parent rewrites the file in place with the same data, then
+   extends it past the part the children read.  Readers of one
+   file should proceed in parallel with each other and with the
+   writes inside the file, and the extending writes should not
+   disturb what they see. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/filesys/extended/syn-read-many.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[BUF_SIZE];
+static char tail[TAIL_SIZE];
+
+#define CHILD_CNT 6
+
+void
+test_main (void)
+{
+  pid_t children[CHILD_CNT];
+  size_t ofs;
+  int fd;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  random_bytes (buf, sizeof buf);
+  CHECK (write (fd, buf, sizeof buf) == BUF_SIZE,
+         "write %d bytes to \"%s\"", (int) BUF_SIZE, file_name);
+
+  exec_children ("child-read-many", children, CHILD_CNT);
+
+  /* Rewrite the file in place, which does not change its length. */
+  quiet = true;
+  seek (fd, 0);
+  for (ofs = 0; ofs < BUF_SIZE; ofs += BLOCK_SECTOR_SIZE)
+    CHECK (write (fd, buf + ofs, BLOCK_SECTOR_SIZE) == BLOCK_SECTOR_SIZE,
+           "rewrite %d bytes at offset %zu in \"%s\"",
+           BLOCK_SECTOR_SIZE, ofs, file_name);
+
+  /* Extend the file, one sector at a time. */
+  random_bytes (tail, sizeof tail);
+  for (ofs = 0; ofs < TAIL_SIZE; ofs += BLOCK_SECTOR_SIZE)
+    CHECK (write (fd, tail + ofs, BLOCK_SECTOR_SIZE) == BLOCK_SECTOR_SIZE,
+           "extend \"%s\" by %d bytes at offset %zu",
+           file_name, BLOCK_SECTOR_SIZE, BUF_SIZE + ofs);
+  quiet = false;
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  wait_children (children, CHILD_CNT);
+}
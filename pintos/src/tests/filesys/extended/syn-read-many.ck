@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(syn-read-many) begin
+(syn-read-many) create "shared"
+(syn-read-many) open "shared"
+(syn-read-many) write 16384 bytes to "shared"
+(syn-read-many) exec child 1 of 6: "child-read-many 0"
+(syn-read-many) exec child 2 of 6: "child-read-many 1"
+(syn-read-many) exec child 3 of 6: "child-read-many 2"
+(syn-read-many) exec child 4 of 6: "child-read-many 3"
+(syn-read-many) exec child 5 of 6: "child-read-many 4"
+(syn-read-many) exec child 6 of 6: "child-read-many 5"
+(syn-read-many) close "shared"
+(syn-read-many) wait for child 1 of 6 returned 0 (expected 0)
+(syn-read-many) wait for child 2 of 6 returned 1 (expected 1)
+(syn-read-many) wait for child 3 of 6 returned 2 (expected 2)
+(syn-read-many) wait for child 4 of 6 returned 3 (expected 3)
+(syn-read-many) wait for child 5 of 6 returned 4 (expected 4)
+(syn-read-many) wait for child 6 of 6 returned 5 (expected 5)
+(syn-read-many) end
+EOF
+pass;
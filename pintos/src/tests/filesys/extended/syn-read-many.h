@@ -0,0 +1,10 @@
+#ifndef TESTS_FILESYS_EXTENDED_SYN_READ_MANY_H
+#define TESTS_FILESYS_EXTENDED_SYN_READ_MANY_H
+
+#define BLOCK_SECTOR_SIZE 512
+#define BUF_SIZE (BLOCK_SECTOR_SIZE * 32)
+#define TAIL_SIZE (BLOCK_SECTOR_SIZE * 8)
+#define PASS_CNT 8
+static const char file_name[] = "shared";
+
+#endif /* tests/filesys/extended/syn-read-many.h */
@@ -89,7 +89,9 @@ static bool
 archive_file (char file_name[], size_t file_name_size,
               int archive_fd, bool *write_error)
 {
-  int file_fd = open (file_name);
+  /* Each file is read once from start to end, so read it around
+     the buffer cache. */
+  int file_fd = open_flags (file_name, OPEN_DIRECT);
   if (file_fd >= 0)
     {
       bool success;
@@ -0,0 +1,153 @@
+/* Test program and microbenchmark for bitmap_scan() in
+   lib/kernel/bitmap.c.
+
+   Checks bitmap_scan() against a bit-by-bit reference scan on
+   bitmaps of various sizes and densities, with and without a
+   summary, and then times both on a large, mostly full bitmap,
+   the case that matters for palloc and the free map.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/test.h"
+
+/* Largest bitmap checked for correctness, in bits. */
+#define MAX_BITS 10000
+
+/* Size of the bitmap used for timing, in bits, and number of
+   scans timed. */
+#define BENCH_BITS (1024 * 1024)
+#define BENCH_SCANS 100
+
+static size_t reference_scan (const struct bitmap *, size_t start,
+                              size_t cnt, bool value);
+static void fill (struct bitmap *, int percent_set);
+static void check (struct bitmap *);
+static void bench (struct bitmap *, const char *what);
+
+/* Test the bitmap implementation. */
+void
+test (void)
+{
+  static const int densities[] = {0, 50, 90, 99, 100};
+  struct bitmap *b;
+  size_t size;
+  size_t i;
+
+  printf ("testing various size bitmaps:");
+  for (size = 0; size < MAX_BITS; size = size * 3 / 2 + 1)
+    {
+      printf (" %zu", size);
+      for (i = 0; i < sizeof densities / sizeof *densities; i++)
+        {
+          b = bitmap_create (size);
+          ASSERT (b != NULL);
+          fill (b, densities[i]);
+          check (b);
+          ASSERT (bitmap_enable_summary (b));
+          check (b);
+
+          /* Changes after the summary is built must keep it up to
+             date. */
+          fill (b, 100 - densities[i]);
+          check (b);
+          bitmap_destroy (b);
+        }
+    }
+  printf (" done\n");
+
+  b = bitmap_create (BENCH_BITS);
+  ASSERT (b != NULL);
+  fill (b, 99);
+  bitmap_reset (b, BENCH_BITS - 2);
+  bitmap_reset (b, BENCH_BITS - 1);
+  bench (b, "99% full, word scan");
+  ASSERT (bitmap_enable_summary (b));
+  bench (b, "99% full, summary");
+  bitmap_destroy (b);
+
+  printf ("bitmap: PASS\n");
+}
+
+/* Sets about PERCENT_SET percent of the bits in B, at random, and
+   clears the rest. */
+static void
+fill (struct bitmap *b, int percent_set)
+{
+  size_t i;
+
+  for (i = 0; i < bitmap_size (b); i++)
+    bitmap_set (b, i, (int) (random_ulong () % 100) < percent_set);
+}
+
+/* Checks bitmap_scan() on B against reference_scan() for a
+   variety of starting points, lengths, and values. */
+static void
+check (struct bitmap *b)
+{
+  size_t size = bitmap_size (b);
+  int trial;
+
+  for (trial = 0; trial < 64; trial++)
+    {
+      size_t start = size > 0 ? random_ulong () % (size + 1) : 0;
+      size_t cnt = random_ulong () % 70;
+      bool value = trial % 2;
+
+      ASSERT (bitmap_scan (b, start, cnt, value)
+              == reference_scan (b, start, cnt, value));
+    }
+}
+
+/* Times BENCH_SCANS scans of B for a run of two clear bits with
+   bitmap_scan() and with reference_scan(), and prints the results
+   under the title WHAT. */
+static void
+bench (struct bitmap *b, const char *what)
+{
+  int64_t start;
+  int64_t fast, slow;
+  int i;
+
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_SCANS; i++)
+    ASSERT (bitmap_scan (b, 0, 2, false) == BENCH_BITS - 2);
+  fast = timer_elapsed (start);
+
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_SCANS; i++)
+    ASSERT (reference_scan (b, 0, 2, false) == BENCH_BITS - 2);
+  slow = timer_elapsed (start);
+
+  printf ("%s: bitmap_scan %"PRId64" ticks, bit by bit %"PRId64" ticks "
+          "for %d scans of %d bits\n",
+          what, fast, slow, BENCH_SCANS, BENCH_BITS);
+}
+
+/* Finds the first run of CNT bits set to VALUE in B at or after
+   START the slow way, by testing each candidate start bit by
+   bit. */
+static size_t
+reference_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i, j;
+
+  if (cnt > bitmap_size (b))
+    return BITMAP_ERROR;
+  for (i = start; i + cnt <= bitmap_size (b); i++)
+    {
+      for (j = 0; j < cnt; j++)
+        if (bitmap_test (b, i + j) != value)
+          break;
+      if (j == cnt)
+        return i;
+    }
+  return BITMAP_ERROR;
+}
@@ -0,0 +1,147 @@
+/* Microbenchmark for buffer cache lookups in filesys/cache.c.
+
+   Reads a set of sectors that fit in the cache until they are all
+   cached, checks that reading them again hits every time, and then
+   times many reads of them through cache_read(), which finds each
+   one with a single probe of the cache's sector index.  For
+   comparison it times the same reads against a table of the same
+   size searched the way the cache used to be, by taking and
+   dropping every entry's lock in turn until the sector turns up.
+
+   The cost of the indexed lookups should stay about the same when
+   the kernel is booted with a larger -cache=N, while the linear
+   search grows with N.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/timer.h"
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/test.h"
+
+/* Number of times each hot sector is read while timing. */
+#define BENCH_ROUNDS 64
+
+/* An entry in the linearly searched table. */
+struct linear_entry
+  {
+    struct lock lock;           /* Taken to examine the entry. */
+    block_sector_t sector;      /* Sector held. */
+    uint8_t *data;              /* Sector data. */
+  };
+
+static void bench_cache (block_sector_t hot_cnt);
+static void bench_linear (size_t entry_cnt, block_sector_t hot_cnt);
+static uint8_t buffer[BLOCK_SECTOR_SIZE];
+
+/* Benchmark buffer cache lookups. */
+void
+test (void)
+{
+  size_t entry_cnt = cache_get_size ();
+  block_sector_t hot_cnt = entry_cnt / 2;
+  long long accesses, hits, misses, base_accesses, base_hits;
+  block_sector_t sector;
+
+  ASSERT (fs_device != NULL);
+  if (hot_cnt > block_size (fs_device))
+    hot_cnt = block_size (fs_device);
+
+  /* Warm the cache, then check that the hot sectors all hit. */
+  for (sector = 0; sector < hot_cnt; sector++)
+    cache_read (fs_device, sector, buffer, 0, BLOCK_SECTOR_SIZE);
+  ASSERT (cache_get_stats (&base_accesses, &base_hits, &misses,
+                           NULL, NULL) == 0);
+  for (sector = 0; sector < hot_cnt; sector++)
+    cache_read (fs_device, sector, buffer, 0, BLOCK_SECTOR_SIZE);
+  ASSERT (cache_get_stats (&accesses, &hits, &misses, NULL, NULL) == 0);
+  ASSERT (accesses - base_accesses == hot_cnt);
+  ASSERT (hits - base_hits == hot_cnt);
+
+  printf ("cache: %zu entries, %"PRDSNu" hot sectors, %d rounds\n",
+          entry_cnt, hot_cnt, BENCH_ROUNDS);
+  bench_cache (hot_cnt);
+  bench_linear (entry_cnt, hot_cnt);
+  printf ("cache: PASS\n");
+}
+
+/* Times BENCH_ROUNDS reads of each of the first HOT_CNT sectors
+   through the cache, in a random order each round. */
+static void
+bench_cache (block_sector_t hot_cnt)
+{
+  int64_t start = timer_ticks ();
+  int round;
+  block_sector_t k;
+
+  for (round = 0; round < BENCH_ROUNDS; round++)
+    for (k = 0; k < hot_cnt; k++)
+      cache_read (fs_device, random_ulong () % hot_cnt, buffer, 0,
+                  BLOCK_SECTOR_SIZE);
+  printf ("cache: indexed lookup %"PRId64" ticks\n", timer_elapsed (start));
+}
+
+/* Times the same reads as bench_cache() against a table of
+   ENTRY_CNT entries holding HOT_CNT sectors, searched linearly. */
+static void
+bench_linear (size_t entry_cnt, block_sector_t hot_cnt)
+{
+  struct linear_entry *table = malloc (entry_cnt * sizeof *table);
+  uint8_t *data = malloc (BLOCK_SECTOR_SIZE);
+  int64_t start;
+  int round;
+  block_sector_t k;
+  size_t i;
+
+  ASSERT (table != NULL && data != NULL);
+
+  /* Put the hot sectors at random places among unused entries. */
+  for (i = 0; i < entry_cnt; i++)
+    {
+      lock_init (&table[i].lock);
+      table[i].sector = (block_sector_t) -1;
+      table[i].data = data;
+    }
+  for (k = 0; k < hot_cnt; k++)
+    {
+      do
+        i = random_ulong () % entry_cnt;
+      while (table[i].sector != (block_sector_t) -1);
+      table[i].sector = k;
+    }
+
+  start = timer_ticks ();
+  for (round = 0; round < BENCH_ROUNDS; round++)
+    for (k = 0; k < hot_cnt; k++)
+      {
+        block_sector_t sector = random_ulong () % hot_cnt;
+
+        for (i = 0; i < entry_cnt; i++)
+          {
+            lock_acquire (&table[i].lock);
+            if (table[i].sector == sector)
+              {
+                memcpy (buffer, table[i].data, BLOCK_SECTOR_SIZE);
+                lock_release (&table[i].lock);
+                break;
+              }
+            lock_release (&table[i].lock);
+          }
+        ASSERT (i < entry_cnt);
+      }
+  printf ("cache: linear search %"PRId64" ticks\n", timer_elapsed (start));
+
+  free (data);
+  free (table);
+}
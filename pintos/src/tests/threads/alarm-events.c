@@ -0,0 +1,112 @@
+/* Arms timer events for various numbers of ticks in the future,
+   cancels one of them, and checks that the rest run on exactly
+   the tick they were armed for.  Then arms two high-resolution
+   events for a few milliseconds into a tick and checks that they
+   run, in order, before the next tick. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* An event under test. */
+struct test_event
+  {
+    struct timer_event event;   /* The event. */
+    int64_t expires;            /* Tick it should run on. */
+    int64_t ran;                /* Tick it ran on, or -1. */
+    int order;                  /* Order in which it ran. */
+  };
+
+static timer_event_func record;
+static struct semaphore done;
+static int next_order;
+
+/* Ticks from now to arm each event for.  These cover all of the
+   first two levels of the timer wheel and the boundary between
+   them. */
+static const int delays[] = {1, 7, 63, 64, 65, 130, 300};
+#define EVENT_CNT (sizeof delays / sizeof *delays)
+#define CANCEL_IDX 4
+
+static const int hires_us[] = {2000, 5000};
+#define HIRES_CNT (sizeof hires_us / sizeof *hires_us)
+
+void
+test_alarm_events (void)
+{
+  struct test_event events[EVENT_CNT];
+  struct test_event hires[HIRES_CNT];
+  int64_t start;
+  size_t i;
+
+  sema_init (&done, 0);
+
+  msg ("Arming %d timer events, then cancelling one.", (int) EVENT_CNT);
+  timer_sleep (1);
+  start = timer_ticks ();
+  for (i = 0; i < EVENT_CNT; i++)
+    {
+      events[i].expires = start + delays[i];
+      events[i].ran = -1;
+      timer_event_init (&events[i].event, record, &events[i]);
+      timer_event_arm (&events[i].event, delays[i]);
+    }
+  if (!timer_event_cancel (&events[CANCEL_IDX].event))
+    fail ("event %d was not pending when cancelled", CANCEL_IDX);
+  for (i = 0; i < EVENT_CNT - 1; i++)
+    sema_down (&done);
+
+  for (i = 0; i < EVENT_CNT; i++)
+    if (i == CANCEL_IDX)
+      {
+        if (events[i].ran != -1)
+          fail ("cancelled event %zu ran anyway", i);
+        msg ("event %zu for tick +%d was cancelled.", i, delays[i]);
+      }
+    else if (events[i].ran != events[i].expires)
+      fail ("event %zu for tick +%d ran on tick +%"PRId64,
+            i, delays[i], events[i].ran - start);
+    else
+      msg ("event %zu ran on tick +%d.", i, delays[i]);
+
+  msg ("Arming %d high-resolution events within one tick.",
+       (int) HIRES_CNT);
+  next_order = 0;
+  timer_sleep (1);
+  start = timer_ticks ();
+  for (i = 0; i < HIRES_CNT; i++)
+    {
+      hires[i].expires = start;
+      hires[i].ran = -1;
+      timer_event_init (&hires[i].event, record, &hires[i]);
+      timer_event_arm_ns (&hires[i].event, hires_us[HIRES_CNT - 1 - i] * 1000);
+    }
+  for (i = 0; i < HIRES_CNT; i++)
+    sema_down (&done);
+
+  for (i = 0; i < HIRES_CNT; i++)
+    {
+      size_t idx = HIRES_CNT - 1 - i;
+      if (hires[idx].ran != start)
+        fail ("%d us event ran %"PRId64" ticks late",
+              hires_us[i], hires[idx].ran - start);
+      if (hires[idx].order != (int) i)
+        fail ("%d us event ran out of order", hires_us[i]);
+      msg ("%d us event ran before the next tick.", hires_us[i]);
+    }
+}
+
+/* Records the tick on which the test_event containing E ran. */
+static void
+record (struct timer_event *e UNUSED, void *te_)
+{
+  struct test_event *te = te_;
+
+  te->ran = timer_ticks ();
+  te->order = next_order++;
+  sema_up (&done);
+}
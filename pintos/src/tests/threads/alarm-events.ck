@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alarm-events) begin
+(alarm-events) Arming 7 timer events, then cancelling one.
+(alarm-events) event 0 ran on tick +1.
+(alarm-events) event 1 ran on tick +7.
+(alarm-events) event 2 ran on tick +63.
+(alarm-events) event 3 ran on tick +64.
+(alarm-events) event 4 for tick +65 was cancelled.
+(alarm-events) event 5 ran on tick +130.
+(alarm-events) event 6 ran on tick +300.
+(alarm-events) Arming 2 high-resolution events within one tick.
+(alarm-events) 2000 us event ran before the next tick.
+(alarm-events) 5000 us event ran before the next tick.
+(alarm-events) end
+EOF
+pass;
@@ -0,0 +1,77 @@
+/* Creates 1,000 threads, each of which sleeps for a fixed period
+   of between 10 and 29 ticks over and over, and measures how much
+   of the CPU is left idle while they do.  Sleeping threads should
+   not take CPU time, so even with this many of them the CPU should
+   be idle most of the time. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define SLEEPER_CNT 1000        /* Number of sleeping threads. */
+#define SETTLE_TICKS 50         /* Ticks to let sleepers settle in. */
+#define MEASURE_TICKS 300       /* Ticks to measure CPU use over. */
+
+/* Information about the test. */
+struct sleep_test
+  {
+    int64_t start;              /* Tick at which all threads start. */
+    int64_t end;                /* Tick after which all threads stop. */
+    struct semaphore done;      /* Up'd by each thread when it stops. */
+  };
+
+static thread_func sleeper;
+
+void
+test_alarm_many (void)
+{
+  struct sleep_test test;
+  long long idle_before, kernel_before, user_before;
+  long long idle_after, kernel_after, user_after;
+  long long idle;
+  int i;
+
+  msg ("Creating %d threads to sleep 10 to 29 ticks at a time.",
+       SLEEPER_CNT);
+  test.start = timer_ticks () + 200;
+  test.end = test.start + SETTLE_TICKS + MEASURE_TICKS + 50;
+  sema_init (&test.done, 0);
+  for (i = 0; i < SLEEPER_CNT; i++)
+    if (thread_create ("sleeper", PRI_DEFAULT, sleeper, &test) == TID_ERROR)
+      fail ("creating thread %d failed", i);
+
+  /* Measure the CPU time used once all of the threads are in
+     their sleep loops. */
+  timer_sleep (test.start + SETTLE_TICKS - timer_ticks ());
+  thread_get_stats (&idle_before, &kernel_before, &user_before);
+  timer_sleep (MEASURE_TICKS);
+  thread_get_stats (&idle_after, &kernel_after, &user_after);
+  idle = idle_after - idle_before;
+  msg ("CPU was idle for %lld of %d ticks.", idle, MEASURE_TICKS);
+
+  for (i = 0; i < SLEEPER_CNT; i++)
+    sema_down (&test.done);
+  msg ("All threads finished.");
+
+  if (idle * 2 < MEASURE_TICKS)
+    fail ("sleeping threads kept the CPU busy for %lld of %d ticks",
+          MEASURE_TICKS - idle, MEASURE_TICKS);
+}
+
+/* Sleeper thread.  Thread I sleeps 10 + I % 20 ticks at a time. */
+static void
+sleeper (void *test_)
+{
+  static int next_idx;
+  struct sleep_test *test = test_;
+  int64_t period;
+
+  period = 10 + next_idx++ % 20;
+  timer_sleep (test->start - timer_ticks ());
+  while (timer_ticks () < test->end)
+    timer_sleep (period);
+  sema_up (&test->done);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The idle time varies from run to run, so don't match it exactly.
+s/^\(alarm-many\) CPU was idle for \d+ of (\d+) ticks\.$/(alarm-many) CPU was idle for # of $1 ticks./
+  foreach @output;
+compare_output ("run", \@output, [<<'EOF']);
+(alarm-many) begin
+(alarm-many) Creating 1000 threads to sleep 10 to 29 ticks at a time.
+(alarm-many) CPU was idle for # of 300 ticks.
+(alarm-many) All threads finished.
+(alarm-many) end
+EOF
+pass;
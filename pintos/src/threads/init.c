@@ -34,6 +34,7 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -247,6 +248,18 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-cache"))
+        {
+          if (value == NULL || atoi (value) <= 0
+              || !cache_configure (atoi (value)))
+            PANIC ("invalid cache size `%s' (use -h for help)",
+                   value != NULL ? value : "");
+        }
+      else if (!strcmp (name, "-iosched"))
+        {
+          if (!block_configure_scheduler (value))
+            PANIC ("unknown I/O scheduler `%s'", value);
+        }
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -311,6 +324,7 @@ run_actions (char **argv)
       {"run", 2, run_task},
 #ifdef FILESYS
       {"ls", 1, fsutil_ls},
+      {"frag", 1, fsutil_frag},
       {"cat", 2, fsutil_cat},
       {"rm", 2, fsutil_rm},
       {"extract", 1, fsutil_extract},
@@ -359,6 +373,7 @@ usage (void)
 #endif
 #ifdef FILESYS
           "  ls                 List files in the root directory.\n"
+          "  frag               Report free space and file fragmentation.\n"
           "  cat FILE           Print FILE to the console.\n"
           "  rm FILE            Delete FILE.\n"
           "Use these actions indirectly via `pintos' -g and -p options:\n"
@@ -373,6 +388,9 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -cache=SECTORS     Cache SECTORS disk sectors (default: 1/16 of RAM).\n"
+          "  -iosched=NAME      Schedule disk requests with NAME, one of\n"
+          "                     \"clook\" (default) or \"deadline\".\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
@@ -20,8 +20,10 @@ void sema_self_test (void);
 /* Lock. */
 struct lock
   {
-    struct thread *holder;      /* Thread holding lock (for debugging). */
+    struct thread *holder;      /* Thread holding lock. */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct list_elem elem;      /* Element in holder's locks_held list. */
+    int priority;               /* Priority donated to holder. */
   };
 
 void lock_init (struct lock *);
@@ -41,6 +43,26 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Reader/writer lock.  Any number of readers may hold it at once,
+   or a single writer.  Waiting writers keep new readers out, so
+   that a stream of readers cannot starve a writer. */
+struct rw_lock
+  {
+    struct lock lock;           /* Protects the members below. */
+    struct condition can_read;  /* Signaled when readers may enter. */
+    struct condition can_write; /* Signaled when a writer may enter. */
+    unsigned readers;           /* Number of readers holding the lock. */
+    unsigned waiting_writers;   /* Number of writers waiting. */
+    struct thread *writer;      /* Writer holding the lock, or null. */
+  };
+
+void rw_lock_init (struct rw_lock *);
+void rw_lock_acquire_read (struct rw_lock *);
+void rw_lock_release_read (struct rw_lock *);
+void rw_lock_acquire_write (struct rw_lock *);
+void rw_lock_release_write (struct rw_lock *);
+bool rw_lock_held_for_write (const struct rw_lock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
@@ -4,6 +4,7 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "filesys/file.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
@@ -22,9 +23,13 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running, in one FIFO run queue per
+   priority.  Bit P of ready_mask is set if and only if
+   ready_queues[P] is nonempty, so that the highest priority with a
+   ready thread can be found in constant time. */
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_mask;
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -61,11 +66,36 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Multi-level feedback queue scheduler.
+
+   Once a second, the load average is updated and every thread's
+   recent_cpu decays by a coefficient that depends on it.  Only
+   ready threads and the running thread are brought up to date
+   then, so that the timer interrupt never walks all_list, which
+   may hold thousands of sleeping threads.  Instead, the
+   coefficients for the last DECAY_HISTORY seconds are kept, and a
+   blocked thread catches up on the seconds it missed when it is
+   unblocked.  (A thread blocked for longer than that misses the
+   oldest seconds' decay.)
+
+   Between seconds only the running thread's recent_cpu changes,
+   so only its priority needs recomputing every PRI_RECOMPUTE_TICKS
+   ticks. */
+#define DECAY_HISTORY 64        /* Seconds of decay coefficients kept. */
+#define PRI_RECOMPUTE_TICKS 4   /* # of timer ticks between priority
+                                   updates. */
+static fixed_point_t load_avg;  /* Estimated # of threads ready to run. */
+static fixed_point_t decay_coef[DECAY_HISTORY]; /* Indexed by second. */
+static unsigned decay_epoch;    /* # of seconds of decay so far. */
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
+static void ready_push (struct thread *);
+static void ready_remove (struct thread *);
+static int ready_max_priority (void);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
@@ -73,10 +103,15 @@ static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
 static void init_wait_status (struct thread *t);
+static void mlfqs_second (void);
+static void mlfqs_catch_up (struct thread *);
+static void mlfqs_update_priority (struct thread *);
 
+#ifdef USERPROG
 static void init_fd_list (struct thread *t);
 static int next_fd_num (struct thread *t);
 static void close_all_files (void);
+#endif
 
 
 /* Initializes the threading system by transforming the code
@@ -95,10 +130,14 @@ static void close_all_files (void);
 void
 thread_init (void)
 {
+  int pri;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (pri = PRI_MIN; pri <= PRI_MAX; pri++)
+    list_init (&ready_queues[pri]);
+  ready_mask = 0;
   list_init (&all_list);
 
   /* Set up a thread structure for the running thread. */
@@ -142,6 +181,20 @@ thread_tick (void)
   else
     kernel_ticks++;
 
+  if (thread_mlfqs)
+    {
+      int64_t now = timer_ticks ();
+
+      if (t != idle_thread)
+        t->recent_cpu = fix_add (t->recent_cpu, fix_int (1));
+      if (now % TIMER_FREQ == 0)
+        mlfqs_second ();
+      if (now % PRI_RECOMPUTE_TICKS == 0 && t != idle_thread)
+        mlfqs_update_priority (t);
+      if (ready_max_priority () > t->priority)
+        intr_yield_on_return ();
+    }
+
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
@@ -155,6 +208,19 @@ thread_print_stats (void)
           idle_ticks, kernel_ticks, user_ticks);
 }
 
+/* Stores the number of timer ticks so far that found the CPU
+   idle, in a kernel thread, and in a user process into *IDLE,
+   *KERNEL, and *USER, respectively. */
+void
+thread_get_stats (long long *idle, long long *kernel, long long *user)
+{
+  enum intr_level old_level = intr_disable ();
+  *idle = idle_ticks;
+  *kernel = kernel_ticks;
+  *user = user_ticks;
+  intr_set_level (old_level);
+}
+
 /* Creates a new kernel thread named NAME with the given initial
    PRIORITY, which executes FUNCTION passing AUX as the argument,
    and adds it to the ready queue.  Returns the thread identifier
@@ -167,9 +233,11 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   The new thread starts with priority PRIORITY.  If that is
+   higher than the running thread's, the running thread yields
+   before thread_create() returns, through thread_preempt(), so
+   the new thread runs first.  (Under the MLFQS, the new thread's
+   priority is computed instead, and PRIORITY is ignored.) */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux)
@@ -191,7 +259,9 @@ thread_create (const char *name, int priority,
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
   init_wait_status (t);
+#ifdef USERPROG
   init_fd_list (t);
+#endif
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -210,6 +280,7 @@ thread_create (const char *name, int priority,
 
   /* Add to run queue. */
   thread_unblock (t);
+  thread_preempt ();
   return tid;
 }
 
@@ -231,6 +302,7 @@ init_wait_status (struct thread *t)
   list_push_back (&(parent->children), &(t->own_wait_status->wait_elem));
 }
 
+#ifdef USERPROG
 static void
 init_fd_list (struct thread *t)
 {
@@ -251,6 +323,7 @@ init_fd_list (struct thread *t)
       (t->fd)[i] = fd;
     }
 }
+#endif
 
 /* Puts the current thread to sleep.  It will not be scheduled
    again until awoken by thread_unblock().
@@ -275,7 +348,10 @@ thread_block (void)
    This function does not preempt the running thread.  This can
    be important: if the caller had disabled interrupts itself,
    it may expect that it can atomically unblock a thread and
-   update other data. */
+   update other data.  Call thread_preempt() afterward to give T
+   the CPU if it has a higher priority.  In an interrupt handler,
+   though, the running thread is preempted on return from the
+   interrupt if T has a higher priority. */
 void
 thread_unblock (struct thread *t)
 {
@@ -285,11 +361,35 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  if (thread_mlfqs)
+    {
+      mlfqs_catch_up (t);
+      mlfqs_update_priority (t);
+    }
+  ready_push (t);
   t->status = THREAD_READY;
+  if (intr_context () && t->priority > thread_current ()->priority)
+    intr_yield_on_return ();
   intr_set_level (old_level);
 }
 
+/* Yields the CPU if a ready thread has a higher priority than the
+   running thread.  In an interrupt handler, yields on return from
+   the interrupt instead.  With interrupts off, does nothing, so as
+   not to break up whatever the caller is doing atomically; the
+   running thread is then preempted no later than the end of its
+   time slice. */
+void
+thread_preempt (void)
+{
+  if (ready_max_priority () <= thread_current ()->priority)
+    return;
+  if (intr_context ())
+    intr_yield_on_return ();
+  else if (intr_get_level () == INTR_ON)
+    thread_yield ();
+}
+
 /* Returns the name of the running thread. */
 const char *
 thread_name (void)
@@ -338,13 +438,16 @@ thread_exit (void)
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
   intr_disable ();
+#ifdef USERPROG
   close_all_files ();
+#endif
   list_remove (&thread_current ()->allelem);
   thread_current ()->status = THREAD_DYING;
   schedule ();
   NOT_REACHED ();
 }
 
+#ifdef USERPROG
 static void
 close_all_files (void)
 {
@@ -358,6 +461,7 @@ close_all_files (void)
       free (fd);
     }
 }
+#endif
 
 /* Yields the CPU.  The current thread is not put to sleep and
    may be scheduled again immediately at the scheduler's whim. */
@@ -371,7 +475,7 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread)
-    list_push_back (&ready_list, &cur->elem);
+    ready_push (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
@@ -394,11 +498,59 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's base priority to NEW_PRIORITY, and
+   yields the CPU if that leaves a ready thread with a higher
+   priority.  While other threads donate a higher priority to the
+   current thread, it keeps running at that priority.  Does nothing
+   under the MLFQS, which sets priorities itself. */
 void
 thread_set_priority (int new_priority)
 {
-  thread_current ()->priority = new_priority;
+  struct thread *cur = thread_current ();
+
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  if (thread_mlfqs)
+    return;
+  cur->base_priority = new_priority;
+  thread_recompute_priority (cur);
+  thread_preempt ();
+}
+
+/* Sets T's priority to the greater of its base priority and the
+   priorities donated through the locks that it holds, moving it to
+   the right run queue if it is ready.  Does not preempt. */
+void
+thread_recompute_priority (struct thread *t)
+{
+  enum intr_level old_level;
+  struct list_elem *e;
+  int priority;
+
+  ASSERT (is_thread (t));
+
+  old_level = intr_disable ();
+  priority = t->base_priority;
+  for (e = list_begin (&t->locks_held); e != list_end (&t->locks_held);
+       e = list_next (e))
+    {
+      struct lock *lock = list_entry (e, struct lock, elem);
+      if (lock->priority > priority)
+        priority = lock->priority;
+    }
+
+  if (priority != t->priority)
+    {
+      if (t->status == THREAD_READY)
+        {
+          ready_remove (t);
+          t->priority = priority;
+          ready_push (t);
+        }
+      else
+        t->priority = priority;
+    }
+  intr_set_level (old_level);
 }
 
 /* Returns the current thread's priority. */
@@ -408,35 +560,138 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE, recomputes its
+   priority, and yields the CPU if it no longer has the highest
+   priority. */
 void
-thread_set_nice (int nice UNUSED)
+thread_set_nice (int nice)
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  if (thread_mlfqs)
+    mlfqs_update_priority (cur);
+  intr_set_level (old_level);
+  thread_preempt ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load = fix_round (fix_scale (load_avg, 100));
+  intr_set_level (old_level);
+  return load;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu = fix_round (fix_scale (thread_current ()->recent_cpu, 100));
+  intr_set_level (old_level);
+  return recent_cpu;
+}
+
+/* Updates the load average and decays the recent_cpu of the
+   running thread and of every ready thread, once a second, and
+   recomputes their priorities.  Blocked threads are left for
+   mlfqs_catch_up().  Interrupts must be off. */
+static void
+mlfqs_second (void)
+{
+  struct thread *cur = thread_current ();
+  int ready_threads = cur != idle_thread;
+  fixed_point_t twice_load;
+  struct list ready;
+  int pri;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* Take the ready threads out of the run queues, highest priority
+     first, since their priorities are about to change. */
+  list_init (&ready);
+  for (pri = PRI_MAX; pri >= PRI_MIN; pri--)
+    while (!list_empty (&ready_queues[pri]))
+      {
+        list_push_back (&ready, list_pop_front (&ready_queues[pri]));
+        ready_threads++;
+      }
+  ready_mask = 0;
+
+  load_avg = fix_add (fix_mul (fix_frac (59, 60), load_avg),
+                      fix_frac (ready_threads, 60));
+  twice_load = fix_scale (load_avg, 2);
+  decay_epoch++;
+  decay_coef[decay_epoch % DECAY_HISTORY]
+    = fix_div (twice_load, fix_add (twice_load, fix_int (1)));
+
+  if (cur != idle_thread)
+    {
+      mlfqs_catch_up (cur);
+      mlfqs_update_priority (cur);
+    }
+  while (!list_empty (&ready))
+    {
+      struct thread *t = list_entry (list_pop_front (&ready),
+                                     struct thread, elem);
+      mlfqs_catch_up (t);
+      mlfqs_update_priority (t);
+      ready_push (t);
+    }
+}
+
+/* Applies to T's recent_cpu the decay of each second since it was
+   last brought up to date, or of the last DECAY_HISTORY seconds if
+   that is fewer.  Interrupts must be off. */
+static void
+mlfqs_catch_up (struct thread *t)
+{
+  unsigned missed = decay_epoch - t->cpu_epoch;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (missed > DECAY_HISTORY)
+    missed = DECAY_HISTORY;
+  for (; missed > 0; missed--)
+    {
+      fixed_point_t coef = decay_coef[(decay_epoch - missed + 1)
+                                      % DECAY_HISTORY];
+      t->recent_cpu = fix_add (fix_mul (coef, t->recent_cpu),
+                               fix_int (t->nice));
+    }
+  t->cpu_epoch = decay_epoch;
+}
+
+/* Sets T's priority from its recent_cpu and nice values.  T must
+   not be in a run queue.  Interrupts must be off. */
+static void
+mlfqs_update_priority (struct thread *t)
+{
+  int priority;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  priority = fix_trunc (fix_sub (fix_int (PRI_MAX - t->nice * 2),
+                                 fix_unscale (t->recent_cpu, 4)));
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+  t->priority = t->base_priority = priority;
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -446,8 +701,8 @@ thread_get_recent_cpu (void)
    point it initializes idle_thread, "up"s the semaphore passed
    to it to enable thread_start() to continue, and immediately
    blocks.  After that, the idle thread never appears in the
-   ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
+   run queues.  It is returned by next_thread_to_run() as a
+   special case when the run queues are empty. */
 static void
 idle (void *idle_started_ UNUSED)
 {
@@ -524,11 +779,25 @@ init_thread (struct thread *t, const char *name, int priority)
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
+  t->priority = t->base_priority = priority;
+  list_init (&t->locks_held);
   t->magic = THREAD_MAGIC;
   list_init (&(t->children));
 
   old_level = intr_disable ();
+  if (thread_mlfqs)
+    {
+      /* Inherit the creating thread's nice and recent_cpu values.
+         The initial thread starts with zero for both. */
+      struct thread *parent = running_thread ();
+      if (parent != t)
+        {
+          t->nice = parent->nice;
+          t->recent_cpu = parent->recent_cpu;
+        }
+      t->cpu_epoch = decay_epoch;
+      mlfqs_update_priority (t);
+    }
   list_push_back (&all_list, &t->allelem);
   intr_set_level (old_level);
 }
@@ -546,18 +815,65 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
-/* Chooses and returns the next thread to be scheduled.  Should
-   return a thread from the run queue, unless the run queue is
-   empty.  (If the running thread can continue running, then it
-   will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+/* Chooses and returns the next thread to be scheduled: the
+   thread at the front of the run queue of the highest priority
+   that has any ready threads, or idle_thread if there are none.
+   (If the running thread can continue running, then it will be
+   in a run queue.) */
 static struct thread *
 next_thread_to_run (void)
 {
-  if (list_empty (&ready_list))
+  int pri = ready_max_priority ();
+  struct thread *t;
+
+  if (pri < PRI_MIN)
     return idle_thread;
+
+  t = list_entry (list_pop_front (&ready_queues[pri]), struct thread, elem);
+  if (list_empty (&ready_queues[pri]))
+    ready_mask &= ~((uint64_t) 1 << pri);
+  return t;
+}
+
+/* Adds T to the back of the run queue for its priority.
+   Interrupts must be off. */
+static void
+ready_push (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  list_push_back (&ready_queues[t->priority], &t->elem);
+  ready_mask |= (uint64_t) 1 << t->priority;
+}
+
+/* Removes T from its run queue.  Interrupts must be off. */
+static void
+ready_remove (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[t->priority]))
+    ready_mask &= ~((uint64_t) 1 << t->priority);
+}
+
+/* Returns the highest priority of any ready thread, or
+   PRI_MIN - 1 if no thread is ready. */
+static int
+ready_max_priority (void)
+{
+  uint32_t high = ready_mask >> 32;
+  uint32_t low = ready_mask;
+
+  /* Find the most significant set bit of each half with a single
+     BSR instruction, rather than a loop. */
+  if (high != 0)
+    return 63 - __builtin_clz (high);
+  else if (low != 0)
+    return 31 - __builtin_clz (low);
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    return PRI_MIN - 1;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -647,6 +963,7 @@ allocate_tid (void)
    Used by switch.S, which can't figure it out on its own. */
 uint32_t thread_stack_ofs = offsetof (struct thread, stack);
 
+#ifdef USERPROG
 /* Add file to current thread and return the
 fd number assigned to it */
 int
@@ -718,3 +1035,4 @@ get_file (struct thread *t, int fd) {
 
   return NULL;
 }
+#endif /* USERPROG */
@@ -2,6 +2,7 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <heap.h>
 #include <list.h>
 #include <stdint.h>
 #include "threads/synch.h"
@@ -27,6 +28,10 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread nice values. */
+#define NICE_MIN -20                    /* Nicest to other threads. */
+#define NICE_MAX 20                     /* Least nice. */
+
 /* File descriptor number to file */
 #define MAX_FD 128
 
@@ -90,10 +95,10 @@ struct fd
    value, triggering the assertion. */
 /* The `elem' member has a dual purpose.  It can be an element in
    the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+   semaphore wait list (synch.c).  It can be used these ways only
+   because they are mutually exclusive: only a thread in the ready
+   state is on the run queue, whereas only a thread in the blocked
+   state is on a semaphore wait list. */
 struct thread
   {
     /* Owned by thread.c. */
@@ -101,13 +106,25 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Priority, with donations. */
+    int base_priority;                  /* Priority without donations. */
+    int nice;                           /* Niceness, for the MLFQS. */
+    fixed_point_t recent_cpu;           /* Recent CPU time, for the MLFQS. */
+    unsigned cpu_epoch;                 /* Second recent_cpu is current to. */
     struct list_elem allelem;           /* List element for all threads list. */
     struct list children;               /* List of child elems */
     struct wait_status *own_wait_status;
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
+    struct list locks_held;             /* Locks held, which may donate. */
+
+    /* Owned by synch.c. */
+    struct lock *waiting_lock;          /* Lock waited for, or null. */
+
+    /* Owned by devices/timer.c. */
+    struct heap_elem sleep_elem;        /* Element in sleepers heap. */
+    int64_t wakeup_time;                /* Tick to wake up at, if sleeping. */
 
     /* Thread's current working directory */
     struct dir *working_dir;
@@ -134,12 +151,15 @@ void thread_start (void);
 
 void thread_tick (void);
 void thread_print_stats (void);
+void thread_get_stats (long long *idle, long long *kernel, long long *user);
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
 
 void thread_block (void);
 void thread_unblock (struct thread *);
+void thread_preempt (void);
+void thread_recompute_priority (struct thread *);
 
 struct thread *thread_current (void);
 tid_t thread_tid (void);
@@ -160,10 +180,12 @@ void thread_set_nice (int);
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
 
+#ifdef USERPROG
 int add_fd (struct file *file);
 void assign_fd_dir (struct thread *t, struct dir *dir, int fd);
 struct dir *get_fd_dir (struct thread *t, int fd);
 void remove_fd (struct thread *t, int fd);
 struct file *get_file (struct thread *t, int fd);
+#endif
 
 #endif /* threads/thread.h */
@@ -44,9 +44,17 @@ static void syscall_inumber (uint32_t *args UNUSED, uint32_t *eax UNUSED);
 static void syscall_invcache (uint32_t *args UNUSED, uint32_t *eax UNUSED);
 static void syscall_cachestat (uint32_t *args UNUSED, uint32_t *eax UNUSED);
 static void syscall_diskstat (uint32_t *args UNUSED, uint32_t *eax UNUSED);
+static void syscall_prefetchstat (uint32_t *args UNUSED, uint32_t *eax UNUSED);
+static void syscall_open_flags (uint32_t *args UNUSED, uint32_t *eax UNUSED);
+static void syscall_readdir_many (uint32_t *args UNUSED, uint32_t *eax UNUSED);
+static int open_file (const char *file_name, int flags);
+
+/* Flags for SYS_OPEN_FLAGS.  Must match lib/user/syscall.h. */
+#define OPEN_DIRECT 0x1
 
 static bool args_valid (uint32_t *arg, int num_args);
 static bool arg_addr_valid (void *arg);
+static bool arg_buffer_valid (void *arg, size_t size);
 
 
 void
@@ -76,6 +84,9 @@ syscall_init (void)
   syscalls[SYS_INVCACHE] = syscall_invcache;
   syscalls[SYS_CACHESTAT] = syscall_cachestat;
   syscalls[SYS_DISKSTAT] = syscall_diskstat;
+  syscalls[SYS_PREFETCHSTAT] = syscall_prefetchstat;
+  syscalls[SYS_OPEN_FLAGS] = syscall_open_flags;
+  syscalls[SYS_READDIR_MANY] = syscall_readdir_many;
 }
 
 static void
@@ -180,7 +191,30 @@ syscall_open (uint32_t *args UNUSED, uint32_t *eax UNUSED)
   if (!args_valid (args, 1) || !arg_addr_valid ((void *) args[0]))
     exit_ (-1);
 
-  char *file_name = (char *) args[0];
+  *eax = open_file ((char *) args[0], 0);
+}
+
+static void
+syscall_open_flags (uint32_t *args UNUSED, uint32_t *eax UNUSED)
+{
+  if (!args_valid (args, 2) || !arg_addr_valid ((void *) args[0]))
+    exit_ (-1);
+
+  int flags = (int) args[1];
+  if (flags & ~OPEN_DIRECT)
+    {
+      *eax = -1;
+      return;
+    }
+
+  *eax = open_file ((char *) args[0], flags);
+}
+
+/* Opens FILE_NAME with OPEN_* FLAGS and returns its new file
+   descriptor, or -1 on failure. */
+static int
+open_file (const char *file_name, int flags)
+{
   struct file *file = filesys_open (file_name);
 
   int fd;
@@ -190,11 +224,13 @@ syscall_open (uint32_t *args UNUSED, uint32_t *eax UNUSED)
       struct inode *inode = file_get_inode (file);
       if (inode != NULL && inode_is_dir (inode))
         assign_fd_dir (thread_current (), dir_open (inode_reopen (inode)), fd);
+      else if (flags & OPEN_DIRECT)
+        file_set_direct (file, true);
     }
   else
     fd = -1;
 
-  *eax = fd;
+  return fd;
 }
 
 static void
@@ -388,6 +424,34 @@ syscall_readdir (uint32_t *args UNUSED, uint32_t *eax UNUSED)
     *eax = -1;
 }
 
+/* Fills up to N records, each a struct readdir_entry in
+   lib/user/syscall.h, with the next entries of directory FD.
+   Returns the number filled, 0 at the end of the directory, or -1
+   if FD is not an open directory. */
+static void
+syscall_readdir_many (uint32_t *args UNUSED, uint32_t *eax UNUSED)
+{
+  if (!args_valid (args, 3))
+    exit_ (-1);
+
+  int fd = args[0];
+  struct dir_record *records = (struct dir_record *) args[1];
+  int cnt = args[2];
+  if (cnt < 0 || (size_t) cnt > SIZE_MAX / sizeof *records
+      || !arg_buffer_valid (records, cnt * sizeof *records))
+    exit_ (-1);
+
+  struct file *file = get_file (thread_current (), fd);
+  struct inode *inode = file != NULL ? file_get_inode (file) : NULL;
+  if (inode == NULL || !inode_is_dir (inode))
+    *eax = -1;
+  else
+    {
+      struct dir *dir = get_fd_dir (thread_current (), fd);
+      *eax = dir_readdir_many (dir, records, cnt);
+    }
+}
+
 static void
 syscall_isdir (uint32_t *args UNUSED, uint32_t *eax UNUSED)
 {
@@ -438,7 +502,8 @@ syscall_cachestat (uint32_t *args UNUSED, uint32_t *eax UNUSED)
       return;
     }
 
-  *eax = cache_get_stats ((long long *) args[0], (long long *) args[1], (long long *) args[2]);
+  *eax = cache_get_stats ((long long *) args[0], (long long *) args[1], (long long *) args[2],
+                          NULL, NULL);
 }
 
 static void
@@ -454,6 +519,22 @@ syscall_diskstat (uint32_t *args UNUSED, uint32_t *eax UNUSED)
   *eax = block_get_stats (fs_device, (long long *) args[0], (long long *) args[1]);
 }
 
+static void
+syscall_prefetchstat (uint32_t *args UNUSED, uint32_t *eax UNUSED)
+{
+  long long access_count, hit_count, miss_count;
+
+  if (!args_valid (args, 2) || !arg_addr_valid ((void *) args[0]) ||
+      !arg_addr_valid ((void *) args[1]))
+    {
+      *eax = -1;
+      return;
+    }
+
+  *eax = cache_get_stats (&access_count, &hit_count, &miss_count,
+                          (long long *) args[0], (long long *) args[1]);
+}
+
 /* Does not check validity of dispatch function arguments.
    Only checks that stack arguments (argv, argc, etc.) are valid.
    Keep in mind that each argv[i] points to a char * which could
@@ -487,3 +568,20 @@ arg_addr_valid (void *arg)
 
   return true;
 }
+
+/* Checks every page of the SIZE bytes at ARG. */
+static bool
+arg_buffer_valid (void *arg, size_t size)
+{
+  uint8_t *p = arg;
+  uint8_t *end = p + size;
+
+  if (size == 0)
+    return true;
+  if (end < p || !arg_addr_valid (end - 1))
+    return false;
+  for (; p < end; p = pg_round_down (p) + PGSIZE)
+    if (!arg_addr_valid (p))
+      return false;
+  return true;
+}